@@ -0,0 +1,258 @@
+/*! @file
+ *  Replays synthetic access streams through the cache.H models without Pin,
+ *  reports simulated accesses per second and checks the hit/miss counts of
+ *  every model and stream against golden values.
+ *
+ *  Usage: cachebench [-golden]
+ *  -golden prints the golden table for the current models instead of
+ *  checking it, for when a model change is meant to change the counts.
+ */
+
+#include "pin_shim.H"
+#include "../cache.H"
+
+#include <ctime>
+#include <cstring>
+
+using std::cout;
+using std::endl;
+
+struct ACCESS
+{
+    ADDRINT addr;
+    UINT32 size;
+    CACHE_BASE::ACCESS_TYPE type;
+};
+
+typedef std::vector<ACCESS> STREAM;
+
+/// Deterministic generator so the streams do not depend on the C library
+class LCG
+{
+  private:
+    UINT64 _state;
+
+  public:
+    LCG(UINT64 seed) : _state(seed) {}
+    UINT32 Next()
+    {
+        _state = _state * 6364136223846793005ULL + 1442695040888963407ULL;
+        return _state >> 33;
+    }
+};
+
+VOID Push(STREAM & stream, ADDRINT addr, UINT32 size, CACHE_BASE::ACCESS_TYPE type)
+{
+    ACCESS access;
+    access.addr = addr;
+    access.size = size;
+    access.type = type;
+    stream.push_back(access);
+}
+
+/// 4 byte loads over 1 MB, then 32 byte stores over the same range
+STREAM Sequential()
+{
+    STREAM stream;
+    for (ADDRINT addr = 0; addr < MEGA; addr += 4) Push(stream, 0x10000000 + addr, 4, CACHE_BASE::ACCESS_TYPE_LOAD);
+    for (ADDRINT addr = 0; addr < MEGA; addr += 32) Push(stream, 0x10000000 + addr, 32, CACHE_BASE::ACCESS_TYPE_STORE);
+    return stream;
+}
+
+/// Column walks of a 1024 x 1024 float matrix with a padded row of 4160 bytes
+STREAM Strided()
+{
+    STREAM stream;
+    for (UINT32 column = 0; column < 256; column++)
+    {
+        for (UINT32 row = 0; row < 1024; row++)
+        {
+            Push(stream, 0x20000000 + row * 4160 + column * 4, 4,
+                 row % 4 == 3 ? CACHE_BASE::ACCESS_TYPE_STORE : CACHE_BASE::ACCESS_TYPE_LOAD);
+        }
+    }
+    return stream;
+}
+
+/// Uniform 8 byte accesses over 4 MB, one in four a store
+STREAM Random()
+{
+    STREAM stream;
+    LCG lcg(42);
+    for (UINT32 i = 0; i < MEGA; i++)
+    {
+        const UINT32 value = lcg.Next();
+        Push(stream, 0x30000000 + ((value >> 2) & (4 * MEGA - 8)), 8,
+             value % 4 == 0 ? CACHE_BASE::ACCESS_TYPE_STORE : CACHE_BASE::ACCESS_TYPE_LOAD);
+    }
+    return stream;
+}
+
+/// The gemm_nn loop nest: C[i][j] += A[i][k] * B[k][j], M = 32, N = 1024, K = 64
+STREAM Gemm()
+{
+    const UINT32 M = 32, N = 1024, K = 64;
+    const ADDRINT A = 0x40000000, B = 0x41000000, C = 0x42000000;
+
+    STREAM stream;
+    for (UINT32 i = 0; i < M; i++)
+    {
+        for (UINT32 k = 0; k < K; k++)
+        {
+            Push(stream, A + (i * K + k) * 4, 4, CACHE_BASE::ACCESS_TYPE_LOAD);
+            for (UINT32 j = 0; j < N; j++)
+            {
+                Push(stream, B + (k * N + j) * 4, 4, CACHE_BASE::ACCESS_TYPE_LOAD);
+                Push(stream, C + (i * N + j) * 4, 4, CACHE_BASE::ACCESS_TYPE_LOAD);
+                Push(stream, C + (i * N + j) * 4, 4, CACHE_BASE::ACCESS_TYPE_STORE);
+            }
+        }
+    }
+    return stream;
+}
+
+/*!
+ *  @brief Replays stream through cache the way dcache does: accesses of at
+ *  most 4 bytes that do not cross a line take the single line path
+ */
+template <class T>
+double Replay(T & cache, const STREAM & stream)
+{
+    const ADDRINT lineMask = cache.LineSize() - 1;
+    const clock_t start = clock();
+
+    for (UINT32 i = 0; i < stream.size(); i++)
+    {
+        const ACCESS & access = stream[i];
+        if (access.size <= 4 && (access.addr & lineMask) + access.size <= cache.LineSize())
+        {
+            cache.AccessSingleLine(access.addr, access.type);
+        }
+        else
+        {
+            cache.Access(access.addr, access.size, access.type);
+        }
+    }
+    return double(clock() - start) / CLOCKS_PER_SEC;
+}
+
+struct GOLDEN
+{
+    const char * model;
+    const char * stream;
+    CACHE_STATS hits;
+    CACHE_STATS misses;
+};
+
+// hits and misses of every model and stream, regenerate with -golden
+const GOLDEN golden[] =
+{
+#include "golden.inc"
+};
+
+typedef CACHE_DIRECT_MAPPED(4 * KILO, CACHE_ALLOC::STORE_ALLOCATE) DM;
+typedef CACHE_ROUND_ROBIN(KILO, 8, CACHE_ALLOC::STORE_ALLOCATE) RR;
+typedef CACHE_LRU(4 * KILO, 16, CACHE_ALLOC::STORE_ALLOCATE) LRU;
+typedef CACHE_LRU(4 * KILO, 16, CACHE_ALLOC::STORE_NO_ALLOCATE) LRU_NO_ALLOCATE;
+typedef CACHE_COLUMN_ASSOC(KILO, 2, CACHE_ALLOC::STORE_ALLOCATE) COL;
+typedef CACHE_SKEWED_ASSOC(KILO, 4, CACHE_ALLOC::STORE_ALLOCATE) SKEW;
+
+class BENCH
+{
+  private:
+    const bool _update;
+    UINT32 _failures;
+
+    const GOLDEN * Find(const string & model, const string & stream) const
+    {
+        for (UINT32 i = 0; i < sizeof(golden) / sizeof(golden[0]); i++)
+        {
+            if (model == golden[i].model && stream == golden[i].stream) return &golden[i];
+        }
+        return NULL;
+    }
+
+  public:
+    BENCH(bool update) : _update(update), _failures(0) {}
+
+    UINT32 Failures() const { return _failures; }
+
+    /// Replays stream through a fresh cache made by new, checks and prints the result
+    template <class T>
+    VOID Run(const string & model, T * cache, const string & streamName, const STREAM & stream)
+    {
+        const double seconds = Replay(*cache, stream);
+        const CACHE_STATS hits = cache->Hits();
+        const CACHE_STATS misses = cache->Misses();
+        delete cache;
+
+        if (_update)
+        {
+            cout << "    { \"" << model << "\", \"" << streamName << "\", " << hits << ", " << misses << " }," << endl;
+            return;
+        }
+
+        const GOLDEN * expected = Find(model, streamName);
+        string status = "ok";
+        if (expected == NULL)
+        {
+            status = "NO GOLDEN";
+            _failures++;
+        }
+        else if (expected->hits != hits || expected->misses != misses)
+        {
+            status = "FAIL expected " + decstr(expected->hits) + "/" + decstr(expected->misses);
+            _failures++;
+        }
+
+        cout << ljstr(model, 26) << ljstr(streamName, 12)
+             << decstr(hits, 10) << decstr(misses, 10)
+             << fltstr(stream.size() / seconds / 1e6, 2, 10) << "  " << status << endl;
+    }
+};
+
+int main(int argc, char * argv[])
+{
+    const bool update = argc > 1 && strcmp(argv[1], "-golden") == 0;
+    BENCH bench(update);
+
+    const char * names[] = { "sequential", "strided", "random", "gemm" };
+    STREAM streams[] = { Sequential(), Strided(), Random(), Gemm() };
+
+    if (!update)
+    {
+        cout << ljstr("model", 26) << ljstr("stream", 12)
+             << "      hits    misses  Macc/s" << endl;
+    }
+
+    for (UINT32 s = 0; s < 4; s++)
+    {
+        const STREAM & stream = streams[s];
+
+        bench.Run("dm-32k-64", new DM("dm", 32 * KILO, 64, 1), names[s], stream);
+        bench.Run("rr-32k-64-8", new RR("rr", 32 * KILO, 64, 8), names[s], stream);
+        bench.Run("lru-32k-64-8", new LRU("lru", 32 * KILO, 64, 8), names[s], stream);
+        bench.Run("lru-32k-8-4", new LRU("lru", 32 * KILO, 8, 4), names[s], stream);
+        bench.Run("lru-256k-128-16", new LRU("lru", 256 * KILO, 128, 16), names[s], stream);
+        bench.Run("lru-noalloc-32k-64-8", new LRU_NO_ALLOCATE("lru", 32 * KILO, 64, 8), names[s], stream);
+
+        LRU * victim = new LRU("lru", 32 * KILO, 64, 8);
+        victim->AttachBuffer(new VICTIM_BUFFER("victim", VICTIM_BUFFER::KIND_VICTIM, 8));
+        bench.Run("lru-victim8-32k-64-8", victim, names[s], stream);
+
+        LRU * miss = new LRU("lru", 32 * KILO, 64, 8);
+        miss->AttachBuffer(new VICTIM_BUFFER("miss", VICTIM_BUFFER::KIND_MISS, 8));
+        bench.Run("lru-miss8-32k-64-8", miss, names[s], stream);
+
+        bench.Run("col-32k-64-1", new COL("col", 32 * KILO, 64, 1), names[s], stream);
+        bench.Run("col-32k-64-2", new COL("col", 32 * KILO, 64, 2), names[s], stream);
+        bench.Run("skew-32k-64-4", new SKEW("skew", 32 * KILO, 64, 4), names[s], stream);
+    }
+
+    if (!update && bench.Failures() > 0)
+    {
+        cout << bench.Failures() << " mismatches against the golden counts" << endl;
+        return 1;
+    }
+    return 0;
+}
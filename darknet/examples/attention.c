@@ -35,6 +35,8 @@ matrix network_loss_data(network *net, data test)
         net->train = 0;
         net->delta = 0;
         forward_network(net);
+        orig.workspace = net->workspace;
+        orig.workspace_size = net->workspace_size;
         *net = orig;
 
         float *delta = net->layers[net->n-1].output;
@@ -222,6 +222,24 @@ void rescale_net(char *cfgfile, char *weightfile, char *outfile)
     save_weights(net, outfile);
 }
 
+void calibrate(char *cfgfile, char *weightfile, char *listfile, char *outfile)
+{
+    gpu_index = -1;
+    network *net = load_network(cfgfile, weightfile, 0);
+    list *plist = get_paths(listfile);
+    char **paths = (char **)list_to_array(plist);
+    calibrate_int8(net, paths, plist->size, outfile);
+    load_int8_calibration(net, outfile);
+    int8_report(net, paths, plist->size);
+}
+
+void pack_net(char *cfgfile, char *weightfile, char *outfile)
+{
+    gpu_index = -1;
+    network *net = load_network(cfgfile, weightfile, 0);
+    save_packed_weights(net, outfile);
+}
+
 void rgbgr_net(char *cfgfile, char *weightfile, char *outfile)
 {
     gpu_index = -1;
@@ -410,6 +428,32 @@ int main(int argc, char **argv)
     if(find_arg(argc, argv, "-nogpu")) {
         gpu_index = -1;
     }
+    char *kernel = find_char_arg(argc, argv, "-gemm", "packed");
+    if(0 == strcmp(kernel, "naive")) gemm_kernel = GEMM_NAIVE;
+    else if(0 == strcmp(kernel, "packed")) gemm_kernel = GEMM_PACKED;
+    else if(sgemm_set_kernel(kernel)) gemm_kernel = GEMM_PACKED;
+    else {
+        fprintf(stderr, "unknown or unsupported -gemm kernel %s, use naive, packed, scalar, avx2 or avx512\n", kernel);
+        return 0;
+    }
+    if(find_arg(argc, argv, "-im2col")) implicit_conv = 0;
+    if(find_arg(argc, argv, "-nowinograd")) winograd_conv = 0;
+    if(find_arg(argc, argv, "-nofuse")) fused_conv = 0;
+    if(find_arg(argc, argv, "-nofusepool")) fused_pool = 0;
+    char *qkernel = find_char_arg(argc, argv, "-qgemm", 0);
+    if(qkernel && !qgemm_set_kernel(qkernel)){
+        fprintf(stderr, "unknown or unsupported -qgemm kernel %s, use scalar, avx2 or vnni\n", qkernel);
+        return 0;
+    }
+    char *skernel = find_char_arg(argc, argv, "-simd", 0);
+    if(skernel && !simd_set_kernel(skernel)){
+        fprintf(stderr, "unknown or unsupported -simd kernel %s, use scalar, sse or avx2\n", skernel);
+        return 0;
+    }
+    int8_calibration = find_char_arg(argc, argv, "-int8", 0);
+    if(find_arg(argc, argv, "-plan")) plan_memory = 1;
+    pool_threads = find_int_arg(argc, argv, "-threads", 1);
+    if(find_arg(argc, argv, "-affinity")) pool_affinity = 1;
 
 #ifndef GPU
     gpu_index = -1;
@@ -475,6 +519,10 @@ int main(int argc, char **argv)
         normalize_net(argv[2], argv[3], argv[4]);
     } else if (0 == strcmp(argv[1], "rescale")){
         rescale_net(argv[2], argv[3], argv[4]);
+    } else if (0 == strcmp(argv[1], "calibrate")){
+        calibrate(argv[2], argv[3], argv[4], argv[5]);
+    } else if (0 == strcmp(argv[1], "pack")){
+        pack_net(argv[2], argv[3], argv[4]);
     } else if (0 == strcmp(argv[1], "ops")){
         operations(argv[2]);
     } else if (0 == strcmp(argv[1], "speed")){
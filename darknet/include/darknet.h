@@ -24,6 +24,26 @@ extern "C" {
 #define SECRET_NUM -1234
 extern int gpu_index;
 
+typedef enum{
+    GEMM_NAIVE, GEMM_PACKED
+} GEMM_KERNEL;
+extern GEMM_KERNEL gemm_kernel;
+extern int implicit_conv;
+extern int winograd_conv;
+extern int fused_conv;
+extern int fused_pool;
+int sgemm_set_kernel(const char *name);
+const char *sgemm_kernel_name();
+extern int int8_inference;
+extern char *int8_calibration;
+extern int plan_memory;
+extern int pool_threads;
+extern int pool_affinity;
+int qgemm_set_kernel(const char *name);
+const char *qgemm_kernel_name();
+int simd_set_kernel(const char *name);
+const char *simd_kernel_name();
+
 typedef struct{
     int classes;
     char **names;
@@ -150,6 +170,9 @@ struct layer{
     int index;
     int binary;
     int xnor;
+    int winograd;
+    int folded;
+    int quantized;
     int steps;
     int hidden;
     int truth;
@@ -228,6 +251,8 @@ struct layer{
     float * concat_delta;
 
     float * binary_weights;
+    float * winograd_weights;
+    float * packed_weights;
 
     float * biases;
     float * bias_updates;
@@ -253,6 +278,13 @@ struct layer{
 
     float * rolling_mean;
     float * rolling_variance;
+    float * folded_scales;
+    float * folded_biases;
+
+    signed char * qweights;
+    int * qoffsets;
+    float * qscales;
+    float input_scale;
 
     float * x;
     float * x_norm;
@@ -481,6 +513,11 @@ typedef struct network{
     float *truth;
     float *delta;
     float *workspace;
+    size_t workspace_size;
+    float *arena;
+    size_t arena_size;
+    void *weights_map;
+    size_t weights_map_size;
     int train;
     int index;
     float *cost;
@@ -585,6 +622,12 @@ typedef struct{
 
 
 network *load_network(char *cfg, char *weights, int clear);
+void calibrate_int8(network *net, char **paths, int n, char *filename);
+int load_int8_calibration(network *net, char *filename);
+void int8_report(network *net, char **paths, int n);
+void save_packed_weights(network *net, char *filename);
+void plan_network_memory(network *net);
+void unplan_network_memory(network *net);
 load_args get_base_args(network *net);
 
 void free_data(data d);
@@ -1,4 +1,6 @@
 #include "activations.h"
+#include "threadpool.h"
+#include "simd.h"
 
 #include <math.h>
 #include <stdio.h>
@@ -97,12 +99,21 @@ float activate(float x, ACTIVATION a)
     return 0;
 }
 
+typedef struct{
+    float *x;
+    ACTIVATION a;
+} activate_args;
+
+static void activate_range(void *arg, int begin, int end)
+{
+    activate_args *t = arg;
+    simd_activate(t->x + begin, end - begin, t->a);
+}
+
 void activate_array(float *x, const int n, const ACTIVATION a)
 {
-    int i;
-    for(i = 0; i < n; ++i){
-        x[i] = activate(x[i], a);
-    }
+    activate_args t = {x, a};
+    parallel_for(n, PARALLEL_GRAIN, activate_range, &t);
 }
 
 float gradient(float x, ACTIVATION a)
@@ -0,0 +1,213 @@
+#include "arena.h"
+#include "network.h"
+#include "utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+ * Inference memory planner.
+ *
+ * A layer's output is live from the layer that writes it to the last layer
+ * that reads it: the next layer, which gets it as net.input, any route that
+ * lists it and any shortcut that indexes it. The outputs of yolo, region,
+ * detection and iseg layers and of the network output layer are read after
+ * the forward pass, so they live to the end. The batchnorm buffers l.x and
+ * l.x_norm are only scratch within their own layer, and inference never
+ * writes l.x_norm, so the two share one slot. Every such
+ * tensor gets an offset in one arena, largest first, into the smallest gap
+ * left by the tensors whose lifetimes overlap it (best fit), and the layer
+ * buffers are freed and pointed into the arena.
+ *
+ * The arena only holds for forward passes that do not train. Training,
+ * resizing, and anything reading intermediate outputs after the pass call
+ * unplan_network_memory first to give every layer its own buffers back.
+ */
+
+int plan_memory = 0;
+
+#define ARENA_ALIGN 16
+
+typedef struct{
+    int layer;
+    int kind;
+    size_t size;
+    int first, last;
+    size_t offset;
+} arena_tensor;
+
+static int plannable(layer l)
+{
+    return l.output && l.type != RNN && l.type != GRU && l.type != LSTM && l.type != CRNN;
+}
+
+static int read_after_pass(layer l)
+{
+    return l.type == YOLO || l.type == REGION || l.type == DETECTION || l.type == ISEG;
+}
+
+/* dropout runs in place on its input, parse_network_cfg aliases the buffers */
+static int *alias_owners(network *net)
+{
+    int *owner = calloc(net->n, sizeof(int));
+    int i;
+    for(i = 0; i < net->n; ++i){
+        layer l = net->layers[i];
+        owner[i] = (i > 0 && l.type == DROPOUT && l.output == net->layers[i-1].output) ? owner[i-1] : i;
+    }
+    return owner;
+}
+
+static int in_arena(network *net, float *p)
+{
+    return net->arena && p >= net->arena && p < net->arena + net->arena_size/sizeof(float);
+}
+
+static int compare_tensors(const void *a, const void *b)
+{
+    const arena_tensor *x = a, *y = b;
+    if(x->size != y->size) return (x->size < y->size) ? 1 : -1;
+    return x->first - y->first;
+}
+
+static void place_tensors(arena_tensor *t, int n, size_t *total)
+{
+    int *placed = calloc(n, sizeof(int));
+    int count = 0;
+    int i, j;
+    *total = 0;
+    for(i = 0; i < n; ++i){
+        size_t end = 0, best = 0, best_gap = 0;
+        int found = 0;
+        /* placed is kept sorted by offset, so the gaps come in order */
+        for(j = 0; j < count; ++j){
+            arena_tensor p = t[placed[j]];
+            if(p.last < t[i].first || p.first > t[i].last) continue;
+            if(p.offset > end){
+                size_t gap = p.offset - end;
+                if(gap >= t[i].size && (!found || gap < best_gap)){
+                    best = end;
+                    best_gap = gap;
+                    found = 1;
+                }
+            }
+            if(p.offset + p.size > end) end = p.offset + p.size;
+        }
+        t[i].offset = found ? best : end;
+        if(t[i].offset + t[i].size > *total) *total = t[i].offset + t[i].size;
+
+        for(j = count; j > 0 && t[placed[j-1]].offset > t[i].offset; --j) placed[j] = placed[j-1];
+        placed[j] = i;
+        ++count;
+    }
+    free(placed);
+}
+
+void plan_network_memory(network *net)
+{
+#ifdef GPU
+    if(gpu_index >= 0) return;
+#endif
+    if(net->arena) unplan_network_memory(net);
+    int *owner = alias_owners(net);
+    int *last = calloc(net->n, sizeof(int));
+    int i, j;
+    int out = net->n - 1;
+    while(out > 0 && net->layers[out].type == COST) --out;
+
+    for(i = 0; i < net->n; ++i) last[i] = i;
+    for(i = 0; i < net->n; ++i){
+        layer l = net->layers[i];
+        if(i + 1 < net->n && last[owner[i]] < i + 1) last[owner[i]] = i + 1;
+        if(l.type == ROUTE){
+            for(j = 0; j < l.n; ++j){
+                int index = owner[l.input_layers[j]];
+                if(last[index] < i) last[index] = i;
+            }
+        }
+        if(l.type == SHORTCUT && last[owner[l.index]] < i) last[owner[l.index]] = i;
+        if(read_after_pass(l) || i >= out) last[owner[i]] = net->n;
+    }
+
+    arena_tensor *t = calloc((size_t)2*net->n, sizeof(arena_tensor));
+    int n = 0;
+    size_t before = 0;
+    for(i = 0; i < net->n; ++i){
+        layer l = net->layers[i];
+        if(!plannable(net->layers[owner[i]])) continue;
+        size_t size = ((size_t)l.outputs*l.batch + ARENA_ALIGN - 1)/ARENA_ALIGN*ARENA_ALIGN;
+        /* a pool fused into the convolution before it is written in that
+         * layer, while the convolution's input is still read */
+        int first = (i > 0 && l.type == MAXPOOL && net->layers[i-1].type == CONVOLUTIONAL) ? i - 1 : i;
+        if(owner[i] == i){
+            arena_tensor o = {i, 0, size, first, last[i], 0};
+            t[n++] = o;
+        }
+        if(l.x || l.x_norm){
+            arena_tensor x = {i, 1, size, i, i, 0};
+            t[n++] = x;
+        }
+    }
+    for(i = 0; i < n; ++i) before += t[i].kind ? 2*t[i].size : t[i].size;
+    qsort(t, n, sizeof(arena_tensor), compare_tensors);
+
+    size_t total;
+    place_tensors(t, n, &total);
+    net->arena = calloc(total ? total : 1, sizeof(float));
+    net->arena_size = total*sizeof(float);
+    for(i = 0; i < n; ++i){
+        layer *l = &net->layers[t[i].layer];
+        float *p = net->arena + t[i].offset;
+        if(t[i].kind){
+            free(l->x);
+            free(l->x_norm);
+            l->x = l->x_norm = p;
+        } else {
+            free(l->output);
+            l->output = p;
+        }
+    }
+    for(i = 0; i < net->n; ++i){
+        if(owner[i] != i) net->layers[i].output = net->layers[owner[i]].output;
+    }
+    net->output = get_network_output_layer(net).output;
+    fprintf(stderr, "Planned %d activation buffers into a %.2f MB arena, %.2f MB unplanned\n",
+            n, net->arena_size/1e6, before*sizeof(float)/1e6);
+
+    free(t);
+    free(last);
+    free(owner);
+}
+
+void unplan_network_memory(network *net)
+{
+    if(!net->arena) return;
+    int *owner = alias_owners(net);
+    int i;
+    for(i = 0; i < net->n; ++i){
+        layer *l = &net->layers[i];
+        size_t size = (size_t)l->outputs*l->batch;
+        if(owner[i] != i) l->output = net->layers[owner[i]].output;
+        else if(in_arena(net, l->output)) l->output = calloc(size, sizeof(float));
+        if(in_arena(net, l->x)) l->x = calloc(size, sizeof(float));
+        if(in_arena(net, l->x_norm)) l->x_norm = calloc(size, sizeof(float));
+    }
+    free(net->arena);
+    net->arena = 0;
+    net->arena_size = 0;
+    net->output = get_network_output_layer(net).output;
+    free(owner);
+}
+
+void free_network_arena(network *net)
+{
+    int i;
+    for(i = 0; i < net->n; ++i){
+        layer *l = &net->layers[i];
+        if(in_arena(net, l->output)) l->output = 0;
+        if(in_arena(net, l->x)) l->x = 0;
+        if(in_arena(net, l->x_norm)) l->x_norm = 0;
+    }
+    free(net->arena);
+    net->arena = 0;
+    net->arena_size = 0;
+}
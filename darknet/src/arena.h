@@ -0,0 +1,8 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include "darknet.h"
+
+void free_network_arena(network *net);
+
+#endif
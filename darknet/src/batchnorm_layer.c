@@ -132,7 +132,10 @@ void resize_batchnorm_layer(layer *layer, int w, int h)
     fprintf(stderr, "Not implemented\n");
 }
 
-void forward_batchnorm_layer(layer l, network net)
+/* Batchnorm of l.output followed by activation a, one pass over the output
+ * at inference with the packed sgemm kernel and fusion on, darknet's separate
+ * normalize, scale, bias and activation passes otherwise */
+void forward_batchnorm_activate(layer l, network net, ACTIVATION a)
 {
     if(l.type == BATCHNORM) copy_cpu(l.outputs*l.batch, net.input, 1, l.output, 1);
     copy_cpu(l.outputs*l.batch, l.output, 1, l.x, 1);
@@ -147,11 +150,20 @@ void forward_batchnorm_layer(layer l, network net)
 
         normalize_cpu(l.output, l.mean, l.variance, l.batch, l.out_c, l.out_h*l.out_w);   
         copy_cpu(l.outputs*l.batch, l.output, 1, l.x_norm, 1);
+    } else if(fused_conv && gemm_kernel == GEMM_PACKED){
+        normalize_activate_cpu(l.output, l.rolling_mean, l.rolling_variance, l.scales, l.biases, l.batch, l.out_c, l.out_h*l.out_w, a);
+        return;
     } else {
         normalize_cpu(l.output, l.rolling_mean, l.rolling_variance, l.batch, l.out_c, l.out_h*l.out_w);
     }
     scale_bias(l.output, l.scales, l.batch, l.out_c, l.out_h*l.out_w);
     add_bias(l.output, l.biases, l.batch, l.out_c, l.out_h*l.out_w);
+    activate_array(l.output, l.outputs*l.batch, a);
+}
+
+void forward_batchnorm_layer(layer l, network net)
+{
+    forward_batchnorm_activate(l, net, LINEAR);
 }
 
 void backward_batchnorm_layer(layer l, network net)
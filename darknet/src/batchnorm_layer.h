@@ -7,6 +7,7 @@
 
 layer make_batchnorm_layer(int batch, int w, int h, int c);
 void forward_batchnorm_layer(layer l, network net);
+void forward_batchnorm_activate(layer l, network net, ACTIVATION a);
 void backward_batchnorm_layer(layer l, network net);
 
 #ifdef GPU
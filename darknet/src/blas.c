@@ -1,4 +1,6 @@
 #include "blas.h"
+#include "threadpool.h"
+#include "simd.h"
 
 #include <math.h>
 #include <assert.h>
@@ -77,6 +79,11 @@ void shortcut_cpu(int batch, int w1, int h1, int c1, float *add, int w2, int h2,
     int minh = (h1 < h2) ? h1 : h2;
     int minc = (c1 < c2) ? c1 : c2;
 
+    if(w1 == w2 && h1 == h2 && c1 == c2){
+        simd_axpby(batch*w1*h1*c1, s2, add, s1, out);
+        return;
+    }
+
     int i,j,k,b;
     for(b = 0; b < batch; ++b){
         for(k = 0; k < minc; ++k){
@@ -144,19 +151,62 @@ void l2normalize_cpu(float *x, float *dx, int batch, int filters, int spatial)
 }
 
 
+typedef struct{
+    float *x, *mean, *variance, *scales, *biases;
+    int filters, spatial;
+    ACTIVATION a;
+} normalize_args;
+
+/* channels [begin, end) over all of the batch, normalization, scales and
+ * biases folded into one scale and bias per channel */
+static void normalize_channels(void *arg, int begin, int end)
+{
+    normalize_args *t = arg;
+    int j;
+    for(j = begin; j < end; ++j){
+        int f = j % t->filters;
+        float scale = 1./(sqrt(t->variance[f]) + .000001f);
+        if(t->scales) scale *= t->scales[f];
+        float bias = (t->biases ? t->biases[f] : 0) - t->mean[f]*scale;
+        simd_scale_bias_activate(t->x + (size_t)j*t->spatial, t->spatial, scale, bias, t->a);
+    }
+}
+
 void normalize_cpu(float *x, float *mean, float *variance, int batch, int filters, int spatial)
 {
-    int b, f, i;
-    for(b = 0; b < batch; ++b){
-        for(f = 0; f < filters; ++f){
-            for(i = 0; i < spatial; ++i){
-                int index = b*filters*spatial + f*spatial + i;
-                x[index] = (x[index] - mean[f])/(sqrt(variance[f]) + .000001f);
-            }
-        }
+    normalize_activate_cpu(x, mean, variance, 0, 0, batch, filters, spatial, LINEAR);
+}
+
+/* x = a(scales*normalize(x) + biases), batchnorm at inference in one pass */
+void normalize_activate_cpu(float *x, float *mean, float *variance, float *scales, float *biases, int batch, int filters, int spatial, ACTIVATION a)
+{
+    normalize_args t = {x, mean, variance, scales, biases, filters, spatial, a};
+    parallel_for(batch*filters, parallel_channels(spatial), normalize_channels, &t);
+}
+
+typedef struct{
+    float *x, *scales, *biases;
+    int n, size;
+    ACTIVATION a;
+} scale_bias_args;
+
+static void scale_bias_channels(void *arg, int begin, int end)
+{
+    scale_bias_args *t = arg;
+    int i;
+    for(i = begin; i < end; ++i){
+        int f = i % t->n;
+        simd_scale_bias_activate(t->x + (size_t)i*t->size, t->size, t->scales ? t->scales[f] : 1, t->biases ? t->biases[f] : 0, t->a);
     }
 }
 
+/* x = a(scales*x + biases) per channel, scales or biases may be 0 */
+void scale_bias_activate_cpu(float *x, float *scales, float *biases, int batch, int n, int size, ACTIVATION a)
+{
+    scale_bias_args t = {x, scales, biases, n, size, a};
+    parallel_for(batch*n, parallel_channels(size), scale_bias_channels, &t);
+}
+
 void const_cpu(int N, float ALPHA, float *X, int INCX)
 {
     int i;
@@ -190,6 +240,10 @@ void scal_cpu(int N, float ALPHA, float *X, int INCX)
 void fill_cpu(int N, float ALPHA, float *X, int INCX)
 {
     int i;
+    if(INCX == 1){
+        simd_fill(X, N, ALPHA);
+        return;
+    }
     for(i = 0; i < N; ++i) X[i*INCX] = ALPHA;
 }
 
@@ -226,6 +280,10 @@ void inter_cpu(int NX, float *X, int NY, float *Y, int B, float *OUT)
 void copy_cpu(int N, float *X, int INCX, float *Y, int INCY)
 {
     int i;
+    if(INCX == 1 && INCY == 1){
+        if(X != Y) memmove(Y, X, N*sizeof(float));
+        return;
+    }
     for(i = 0; i < N; ++i) Y[i*INCY] = X[i*INCX];
 }
 
@@ -26,6 +26,8 @@ void mean_cpu(float *x, int batch, int filters, int spatial, float *mean);
 void variance_cpu(float *x, float *mean, int batch, int filters, int spatial, float *variance);
 
 void scale_bias(float *output, float *scales, int batch, int n, int size);
+void scale_bias_activate_cpu(float *x, float *scales, float *biases, int batch, int n, int size, ACTIVATION a);
+void normalize_activate_cpu(float *x, float *mean, float *variance, float *scales, float *biases, int batch, int filters, int spatial, ACTIVATION a);
 void backward_scale_cpu(float *x_norm, float *delta, int batch, int n, int size, float *scale_updates);
 void mean_delta_cpu(float *delta, float *variance, int batch, int filters, int spatial, float *mean_delta);
 void  variance_delta_cpu(float *x, float *delta, float *mean, float *variance, int batch, int filters, int spatial, float *variance_delta);
@@ -5,6 +5,7 @@
 #include "cuda.h"
 #include "blas.h"
 #include "gemm.h"
+#include "quantize.h"
 
 #include <math.h>
 #include <stdio.h>
@@ -150,6 +151,10 @@ void update_connected_layer(layer l, update_args a)
 
 void forward_connected_layer(layer l, network net)
 {
+    if(use_int8(l, net)){
+        forward_int8_layer(l, net);
+        return;
+    }
     fill_cpu(l.outputs*l.batch, 0, l.output, 1);
     int m = l.batch;
     int k = l.inputs;
@@ -159,11 +164,11 @@ void forward_connected_layer(layer l, network net)
     float *c = l.output;
     gemm(0,1,m,n,k,1,a,k,b,k,1,c,n);
     if(l.batch_normalize){
-        forward_batchnorm_layer(l, net);
+        forward_batchnorm_activate(l, net, l.activation);
     } else {
         add_bias(l.output, l.biases, l.batch, l.outputs, 1);
+        activate_array(l.output, l.outputs*l.batch, l.activation);
     }
-    activate_array(l.output, l.outputs*l.batch, l.activation);
 }
 
 void backward_connected_layer(layer l, network net)
@@ -5,6 +5,10 @@
 #include "col2im.h"
 #include "blas.h"
 #include "gemm.h"
+#include "winograd.h"
+#include "threadpool.h"
+#include "quantize.h"
+#include "maxpool_layer.h"
 #include <stdio.h>
 #include <time.h>
 
@@ -12,6 +16,84 @@
 #include "xnor_layer.h"
 #endif
 
+int implicit_conv = 1;
+int fused_conv = 1;
+int fused_pool = 1;
+
+static int use_implicit_conv(layer l, network net)
+{
+    return implicit_conv && gemm_kernel == GEMM_PACKED && !net.train && !l.xnor && l.size != 1;
+}
+
+/* GEMM panels of the weights from a packed weight file, already in the order
+ * the micro-kernel loads them, one pack_gemm_a block per group */
+static int use_packed_weights(layer l, network net)
+{
+    return l.packed_weights && gemm_kernel == GEMM_PACKED && !net.train && !l.xnor && !l.binary;
+}
+
+/* Bias, batchnorm and activation applied by the GEMM as it stores the output
+ * instead of in separate passes, for the activations the kernels know */
+static int use_fused_conv(layer l, network net)
+{
+    if(!fused_conv || gemm_kernel != GEMM_PACKED || net.train || l.xnor || l.binary) return 0;
+    if(l.batch_normalize && !l.folded) return 0;
+    return l.activation == LINEAR || l.activation == LEAKY || l.activation == RELU;
+}
+
+/* Floats of convolution output a fused pool band holds at most */
+#define POOL_BAND (64*1024)
+
+/* Pool output rows per band of the convolution l and the maxpool p after it,
+ * 0 if the rows one pool output row covers do not fit in POOL_BAND */
+static int pool_band(layer l, layer p)
+{
+    int rows = POOL_BAND/(l.n*l.out_w);
+    if(rows < p.size) return 0;
+    return (rows - p.size)/p.stride + 1;
+}
+
+/* The maxpool after layer i run by layer i itself, on bands of its output
+ * rows as the GEMM finishes them, so the full convolution output is never
+ * written. Only when the pool is the one reader of that output, and the
+ * convolution would not have run im2col anyway. */
+int use_fused_pool(network net, int i)
+{
+    int j, k;
+    if(!fused_pool || net.train || i < 0 || i + 1 >= net.n) return 0;
+    layer l = net.layers[i];
+    layer p = net.layers[i + 1];
+    if(l.type != CONVOLUTIONAL || p.type != MAXPOOL || l.groups != 1) return 0;
+    if(!use_fused_conv(l, net) || use_int8(l, net) || use_winograd(l, net)) return 0;
+    if(!use_implicit_conv(l, net) && l.size != 1) return 0;
+    if(!pool_band(l, p)) return 0;
+    for(j = i + 2; j < net.n; ++j){
+        layer r = net.layers[j];
+        if(r.type == SHORTCUT && r.index == i) return 0;
+        for(k = 0; r.type == ROUTE && k < r.n; ++k){
+            if(r.input_layers[k] == i) return 0;
+        }
+    }
+    return 1;
+}
+
+/* Folds the rolling mean and variance and the scales into one scale and bias
+ * per filter, out = folded_scales*(w*x) + folded_biases. The weights are left
+ * alone so training and save_weights still see the original parameters. */
+void fold_convolutional_batchnorm(layer *l)
+{
+    int i;
+    if(!l->batch_normalize) return;
+    if(!l->folded_scales) l->folded_scales = calloc(l->n, sizeof(float));
+    if(!l->folded_biases) l->folded_biases = calloc(l->n, sizeof(float));
+    for(i = 0; i < l->n; ++i){
+        float scale = l->scales[i]/(sqrt(l->rolling_variance[i]) + .000001f);
+        l->folded_scales[i] = scale;
+        l->folded_biases[i] = l->biases[i] - l->rolling_mean[i]*scale;
+    }
+    l->folded = 1;
+}
+
 void swap_binary(convolutional_layer *l)
 {
     float *swap = l->weights;
@@ -118,6 +200,19 @@ static size_t get_workspace_size(layer l){
     return (size_t)l.out_h*l.out_w*l.size*l.size*l.c/l.groups*sizeof(float);
 }
 
+/* Workspace layer i needs at inference: its im2col buffer, or the band
+ * buffer when it runs the maxpool after it */
+size_t get_convolutional_forward_workspace(network net, int i)
+{
+    layer l = net.layers[i];
+    if(use_fused_pool(net, i)){
+        layer p = net.layers[i + 1];
+        return (size_t)l.n*((pool_band(l, p) - 1)*p.stride + p.size)*l.out_w*sizeof(float);
+    }
+    if(l.size == 1 || use_implicit_conv(l, net) || use_winograd(l, net)) return 0;
+    return l.workspace_size;
+}
+
 #ifdef GPU
 #ifdef CUDNN
 void cudnn_convolutional_setup(layer *l)
@@ -410,26 +505,12 @@ void resize_convolutional_layer(convolutional_layer *l, int w, int h)
 
 void add_bias(float *output, float *biases, int batch, int n, int size)
 {
-    int i,j,b;
-    for(b = 0; b < batch; ++b){
-        for(i = 0; i < n; ++i){
-            for(j = 0; j < size; ++j){
-                output[(b*n + i)*size + j] += biases[i];
-            }
-        }
-    }
+    scale_bias_activate_cpu(output, 0, biases, batch, n, size, LINEAR);
 }
 
 void scale_bias(float *output, float *scales, int batch, int n, int size)
 {
-    int i,j,b;
-    for(b = 0; b < batch; ++b){
-        for(i = 0; i < n; ++i){
-            for(j = 0; j < size; ++j){
-                output[(b*n + i)*size + j] *= scales[i];
-            }
-        }
-    }
+    scale_bias_activate_cpu(output, scales, 0, batch, n, size, LINEAR);
 }
 
 void backward_bias(float *bias_updates, float *delta, int batch, int n, int size)
@@ -442,11 +523,58 @@ void backward_bias(float *bias_updates, float *delta, int batch, int n, int size
     }
 }
 
+/* Convolution and the maxpool p after it, in bands of pool output rows. A
+ * band convolves only the rows its windows cover, into a buffer that stays
+ * in cache, and pools them straight into p.output. The buffer is the
+ * network workspace, sized for it by get_convolutional_forward_workspace. */
+static void forward_convolutional_pooled(layer l, layer p, network net, const gemm_epilogue *ep)
+{
+    const int m = l.n, ow = l.out_w;
+    const int k = l.size*l.size*l.c;
+    const int offset = -p.pad/2;
+    const float *packed = use_packed_weights(l, net) ? l.packed_weights : 0;
+    const int band = pool_band(l, p);
+    float *rows = net.workspace;
+    int b, i0;
+    for(b = 0; b < l.batch; ++b){
+        float *im = net.input + (size_t)b*l.c*l.h*l.w;
+        for(i0 = 0; i0 < p.out_h; i0 += band){
+            int i1 = (i0 + band < p.out_h) ? i0 + band : p.out_h;
+            int r0 = offset + i0*p.stride;
+            int r1 = offset + (i1 - 1)*p.stride + p.size;
+            if(r0 < 0) r0 = 0;
+            if(r1 > l.out_h) r1 = l.out_h;
+            if(r1 > r0){
+                conv_rows(m, l.weights, k, packed, im, l.c, l.h, l.w, l.size, l.stride, l.pad, r0, r1 - r0, rows, (r1 - r0)*ow, ep);
+            }
+            forward_maxpool_rows(p, rows, r0, r1 - r0, i0, i1, m, p.output + (size_t)b*p.outputs);
+        }
+    }
+}
+
 void forward_convolutional_layer(convolutional_layer l, network net)
 {
     int i, j;
 
-    fill_cpu(l.outputs*l.batch, 0, l.output, 1);
+    if(use_int8(l, net)){
+        forward_int8_layer(l, net);
+        return;
+    }
+
+    gemm_epilogue fused = {0};
+    const int fuse = use_fused_conv(l, net);
+    if(fuse){
+        fused.scales = l.batch_normalize ? l.folded_scales : 0;
+        fused.biases = l.batch_normalize ? l.folded_biases : l.biases;
+        fused.activation = l.activation;
+    } else {
+        fill_cpu(l.outputs*l.batch, 0, l.output, 1);
+    }
+
+    if(use_fused_pool(net, net.index) && net.layers[net.index].output == l.output){
+        forward_convolutional_pooled(l, net.layers[net.index + 1], net, &fused);
+        return;
+    }
 
     if(l.xnor){
         binarize_weights(l.weights, l.n, l.c/l.groups*l.size*l.size, l.binary_weights);
@@ -465,22 +593,41 @@ void forward_convolutional_layer(convolutional_layer l, network net)
             float *c = l.output + (i*l.groups + j)*n*m;
             float *im =  net.input + (i*l.groups + j)*l.c/l.groups*l.h*l.w;
 
-            if (l.size == 1) {
+            gemm_epilogue group = fused;
+            if(group.scales) group.scales += j*m;
+            if(group.biases) group.biases += j*m;
+            const gemm_epilogue *ep = fuse ? &group : 0;
+
+            const float *packed = use_packed_weights(l, net) ? l.packed_weights + j*pack_gemm_a(m, k, 1, 0, k, 0) : 0;
+
+            if (use_winograd(l, net)) {
+                forward_winograd(l, im, c, ep);
+                continue;
+            } else if (l.size == 1) {
                 b = im;
+            } else if (use_implicit_conv(l, net)) {
+                if(packed) conv_prepacked(m, packed, im, l.c/l.groups, l.h, l.w, l.size, l.stride, l.pad, c, n, ep);
+                else conv_implicit(m, 1, a, k, im, l.c/l.groups, l.h, l.w, l.size, l.stride, l.pad, c, n, ep);
+                continue;
             } else {
                 im2col_cpu(im, l.c/l.groups, l.h, l.w, l.size, l.stride, l.pad, b);
             }
-            gemm(0,0,m,n,k,1,a,k,b,n,1,c,n);
+            if(packed) gemm_prepacked(m,n,k,packed,b,n,c,n,ep);
+            else if(ep) gemm_nn_fused(m,n,k,a,k,b,n,c,n,ep);
+            else gemm(0,0,m,n,k,1,a,k,b,n,1,c,n);
         }
     }
 
-    if(l.batch_normalize){
-        forward_batchnorm_layer(l, net);
-    } else {
-        add_bias(l.output, l.biases, l.batch, l.n, l.out_h*l.out_w);
+    if(!fuse){
+        if(l.batch_normalize){
+            forward_batchnorm_activate(l, net, l.activation);
+        } else if(fused_conv && gemm_kernel == GEMM_PACKED){
+            scale_bias_activate_cpu(l.output, 0, l.biases, l.batch, l.n, l.out_h*l.out_w, l.activation);
+        } else {
+            add_bias(l.output, l.biases, l.batch, l.n, l.out_h*l.out_w);
+            activate_array(l.output, l.outputs*l.batch, l.activation);
+        }
     }
-
-    activate_array(l.output, l.outputs*l.batch, l.activation);
     if(l.binary || l.xnor) swap_binary(&l);
 }
 
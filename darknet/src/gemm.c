@@ -5,6 +5,8 @@
 #include <stdio.h>
 #include <math.h>
 
+GEMM_KERNEL gemm_kernel = GEMM_PACKED;
+
 void gemm_bin(int M, int N, int K, float ALPHA, 
         char  *A, int lda, 
         float *B, int ldb,
@@ -169,6 +171,13 @@ void gemm_cpu(int TA, int TB, int M, int N, int K, float ALPHA,
             C[i*ldc + j] *= BETA;
         }
     }
+    if(gemm_kernel == GEMM_PACKED){
+        if(!TA && !TB)
+            gemm_nn_packed(M, N, K, ALPHA,A,lda, B, ldb,C,ldc);
+        else
+            gemm_packed(TA, TB, M, N, K, ALPHA,A,lda, B, ldb,C,ldc);
+        return;
+    }
     if(!TA && !TB)
         gemm_nn(M, N, K, ALPHA,A,lda, B, ldb,C,ldc);
     else if(TA && !TB)
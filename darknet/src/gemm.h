@@ -1,6 +1,17 @@
 #ifndef GEMM_H
 #define GEMM_H
 
+#include <stddef.h>
+#include "darknet.h"
+
+/* Applied to each output row i as C = activation(scales[i]*C + biases[i]),
+ * either array may be 0 */
+typedef struct{
+    const float *scales;
+    const float *biases;
+    ACTIVATION activation;
+} gemm_epilogue;
+
 void gemm_bin(int M, int N, int K, float ALPHA, 
         char  *A, int lda, 
         float *B, int ldb,
@@ -18,6 +29,66 @@ void gemm_cpu(int TA, int TB, int M, int N, int K, float ALPHA,
         float BETA,
         float *C, int ldc);
 
+void gemm_packed(int TA, int TB, int M, int N, int K, float ALPHA,
+        float *A, int lda,
+        float *B, int ldb,
+        float *C, int ldc);
+void gemm_nn_packed(int M, int N, int K, float ALPHA,
+        float *A, int lda,
+        float *B, int ldb,
+        float *C, int ldc);
+void gemm_nn_fused(int M, int N, int K,
+        float *A, int lda,
+        float *B, int ldb,
+        float *C, int ldc,
+        const gemm_epilogue *ep);
+size_t pack_gemm_a(int M, int K, float ALPHA, float *A, int lda, float *packed);
+void gemm_prepacked(int M, int N, int K,
+        const float *packed_a,
+        float *B, int ldb,
+        float *C, int ldc,
+        const gemm_epilogue *ep);
+void conv_implicit(int M, float ALPHA,
+        float *A, int lda,
+        float *im, int channels, int height, int width,
+        int ksize, int stride, int pad,
+        float *C, int ldc,
+        const gemm_epilogue *ep);
+void conv_prepacked(int M,
+        const float *packed_a,
+        float *im, int channels, int height, int width,
+        int ksize, int stride, int pad,
+        float *C, int ldc,
+        const gemm_epilogue *ep);
+void conv_rows(int M,
+        float *A, int lda,
+        const float *packed_a,
+        float *im, int channels, int height, int width,
+        int ksize, int stride, int pad,
+        int row0, int rows,
+        float *C, int ldc,
+        const gemm_epilogue *ep);
+
+/* op(B) of the int8 GEMM: unsigned bytes holding quantized values + 128,
+ * either a strided matrix, B[k*rs + n*cs], or the im2col matrix of an image */
+typedef struct{
+    const unsigned char *B;
+    int rs, cs;
+    const unsigned char *im;
+    int channels, height, width;
+    int ksize, stride, pad;
+    int out_w;
+} qgemm_b;
+
+int qgemm_weight_max();
+void quantize_u8(const float *x, int n, float scale, unsigned char *q);
+size_t pack_qgemm_a(int M, int K, const signed char *A, signed char *packed);
+void qgemm(int M, int N, int K,
+        const signed char *packed_a, const int *offsets,
+        const qgemm_b *b,
+        float *C, int rs, int cs,
+        const gemm_epilogue *ep);
+
 #ifdef GPU
 void gemm_gpu(int TA, int TB, int M, int N, int K, float ALPHA, 
         float *A_gpu, int lda, 
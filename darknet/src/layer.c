@@ -27,6 +27,13 @@ void free_layer(layer l)
     if(l.concat)             free(l.concat);
     if(l.concat_delta)       free(l.concat_delta);
     if(l.binary_weights)     free(l.binary_weights);
+    if(l.winograd_weights)   free(l.winograd_weights);
+    if(l.packed_weights)     free(l.packed_weights);
+    if(l.folded_scales)      free(l.folded_scales);
+    if(l.folded_biases)      free(l.folded_biases);
+    if(l.qweights)           free(l.qweights);
+    if(l.qoffsets)           free(l.qoffsets);
+    if(l.qscales)            free(l.qscales);
     if(l.biases)             free(l.biases);
     if(l.bias_updates)       free(l.bias_updates);
     if(l.scales)             free(l.scales);
@@ -1,4 +1,7 @@
 #include "maxpool_layer.h"
+#include "convolutional_layer.h"
+#include "threadpool.h"
+#include "simd.h"
 #include "cuda.h"
 #include <stdio.h>
 
@@ -76,9 +79,17 @@ void resize_maxpool_layer(maxpool_layer *l, int w, int h)
     #endif
 }
 
-void forward_maxpool_layer(const maxpool_layer l, network net)
+typedef struct{
+    const maxpool_layer *l;
+    float *input;
+} maxpool_args;
+
+/* channels [begin, end) over all of the batch */
+static void maxpool_channels(void *arg, int begin, int end)
 {
-    int b,i,j,k,m,n;
+    const maxpool_layer l = *((maxpool_args *)arg)->l;
+    float *input = ((maxpool_args *)arg)->input;
+    int ch,b,i,j,k,m,n;
     int w_offset = -l.pad/2;
     int h_offset = -l.pad/2;
 
@@ -86,33 +97,118 @@ void forward_maxpool_layer(const maxpool_layer l, network net)
     int w = l.out_w;
     int c = l.c;
 
-    for(b = 0; b < l.batch; ++b){
-        for(k = 0; k < c; ++k){
-            for(i = 0; i < h; ++i){
-                for(j = 0; j < w; ++j){
-                    int out_index = j + w*(i + h*(k + c*b));
-                    float max = -FLT_MAX;
-                    int max_i = -1;
-                    for(n = 0; n < l.size; ++n){
-                        for(m = 0; m < l.size; ++m){
-                            int cur_h = h_offset + i*l.stride + n;
-                            int cur_w = w_offset + j*l.stride + m;
-                            int index = cur_w + l.w*(cur_h + l.h*(k + b*l.c));
-                            int valid = (cur_h >= 0 && cur_h < l.h &&
-                                         cur_w >= 0 && cur_w < l.w);
-                            float val = (valid != 0) ? net.input[index] : -FLT_MAX;
-                            max_i = (val > max) ? index : max_i;
-                            max   = (val > max) ? val   : max;
-                        }
+    for(ch = begin; ch < end; ++ch){
+        b = ch / c;
+        k = ch % c;
+        for(i = 0; i < h; ++i){
+            for(j = 0; j < w; ++j){
+                int out_index = j + w*(i + h*(k + c*b));
+                float max = -FLT_MAX;
+                int max_i = -1;
+                for(n = 0; n < l.size; ++n){
+                    for(m = 0; m < l.size; ++m){
+                        int cur_h = h_offset + i*l.stride + n;
+                        int cur_w = w_offset + j*l.stride + m;
+                        int index = cur_w + l.w*(cur_h + l.h*(k + b*l.c));
+                        int valid = (cur_h >= 0 && cur_h < l.h &&
+                                     cur_w >= 0 && cur_w < l.w);
+                        float val = (valid != 0) ? input[index] : -FLT_MAX;
+                        max_i = (val > max) ? index : max_i;
+                        max   = (val > max) ? val   : max;
                     }
-                    l.output[out_index] = max;
-                    l.indexes[out_index] = max_i;
                 }
+                l.output[out_index] = max;
+                l.indexes[out_index] = max_i;
             }
         }
     }
 }
 
+/* Max of the window at (top, left), input row r at in + (r - row0)*l.w */
+static float maxpool_window(const maxpool_layer *l, const float *in, int row0, int top, int left)
+{
+    float max = -FLT_MAX;
+    int n, m;
+    for(n = 0; n < l->size; ++n){
+        int r = top + n;
+        if(r < 0 || r >= l->h) continue;
+        for(m = 0; m < l->size; ++m){
+            int c = left + m;
+            if(c < 0 || c >= l->w) continue;
+            float val = in[(r - row0)*l->w + c];
+            max = (val > max) ? val : max;
+        }
+    }
+    return max;
+}
+
+/* Output rows [i0, i1) of one channel, without indexes. Windows inside the
+ * input run the simd kernels, only those over the padding check bounds. */
+static void maxpool_channel_rows(const maxpool_layer *l, const float *in, int row0, int i0, int i1, float *out)
+{
+    const int offset = -l->pad/2;
+    const int size = l->size, stride = l->stride;
+    /* columns [j0, j1) have their windows inside the input */
+    int j0 = (-offset + stride - 1)/stride;
+    int j1 = (l->w - size - offset >= 0) ? (l->w - size - offset)/stride + 1 : 0;
+    if(j0 > l->out_w) j0 = l->out_w;
+    if(j1 > l->out_w) j1 = l->out_w;
+    if(j1 < j0) j1 = j0;
+    const int fast = stride == 1 || (size == 2 && stride == 2);
+    int i, j;
+    for(i = i0; i < i1; ++i){
+        int top = offset + i*stride;
+        float *o = out + i*l->out_w;
+        if(!fast || top < 0 || top + size > l->h){
+            for(j = 0; j < l->out_w; ++j) o[j] = maxpool_window(l, in, row0, top, offset + j*stride);
+            continue;
+        }
+        for(j = 0; j < j0; ++j) o[j] = maxpool_window(l, in, row0, top, offset + j*stride);
+        const float *p = in + (top - row0)*l->w + offset + j0*stride;
+        if(stride == 1) simd_max_window(p, l->w, size, j1 - j0, o + j0);
+        else simd_max_2x2s2(p, l->w, j1 - j0, o + j0);
+        for(j = j1; j < l->out_w; ++j) o[j] = maxpool_window(l, in, row0, top, offset + j*stride);
+    }
+}
+
+typedef struct{
+    const maxpool_layer *l;
+    const float *input;
+    int row0, rows, i0, i1;
+    float *output;
+} maxpool_rows_args;
+
+static void maxpool_rows_channels(void *arg, int begin, int end)
+{
+    maxpool_rows_args *t = arg;
+    int ch;
+    for(ch = begin; ch < end; ++ch){
+        maxpool_channel_rows(t->l, t->input + (size_t)ch*t->rows*t->l->w, t->row0, t->i0, t->i1,
+                t->output + (size_t)ch*t->l->out_h*t->l->out_w);
+    }
+}
+
+/* Inference max pool of output rows [i0, i1) of channels channels. Channel k
+ * of input holds the input rows [row0, row0 + rows) at input + k*rows*l.w,
+ * its output goes to output + k*l.out_h*l.out_w. */
+void forward_maxpool_rows(const maxpool_layer l, const float *input, int row0, int rows, int i0, int i1, int channels, float *output)
+{
+    maxpool_rows_args a = {&l, input, row0, rows, i0, i1, output};
+    parallel_for(channels, parallel_channels((i1 - i0)*l.out_w*l.size*l.size), maxpool_rows_channels, &a);
+}
+
+void forward_maxpool_layer(const maxpool_layer l, network net)
+{
+    if(!net.train){
+        /* already pooled by the convolutional layer before it */
+        if(use_fused_pool(net, net.index - 1) && net.layers[net.index].output == l.output) return;
+        forward_maxpool_rows(l, net.input, 0, l.h, 0, l.out_h, l.batch*l.c, l.output);
+        return;
+    }
+    maxpool_args a = {&l, net.input};
+    parallel_for(l.batch*l.c, parallel_channels(l.out_h*l.out_w*l.size*l.size), maxpool_channels, &a);
+}
+
 void backward_maxpool_layer(const maxpool_layer l, network net)
 {
     int i;
@@ -11,6 +11,7 @@ typedef layer maxpool_layer;
 image get_maxpool_image(maxpool_layer l);
 maxpool_layer make_maxpool_layer(int batch, int h, int w, int c, int size, int stride, int padding);
 void resize_maxpool_layer(maxpool_layer *l, int w, int h);
+void forward_maxpool_rows(const maxpool_layer l, const float *input, int row0, int rows, int i0, int i1, int channels, float *output);
 void forward_maxpool_layer(const maxpool_layer l, network net);
 void backward_maxpool_layer(const maxpool_layer l, network net);
 
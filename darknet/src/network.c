@@ -4,6 +4,8 @@
 #include "network.h"
 #include "image.h"
 #include "data.h"
+#include "arena.h"
+#include "packed_weights.h"
 #include "utils.h"
 #include "blas.h"
 
@@ -56,6 +58,8 @@ network *load_network(char *cfg, char *weights, int clear)
     if(weights && weights[0] != 0){
         load_weights(net, weights);
     }
+    if(int8_calibration) load_int8_calibration(net, int8_calibration);
+    if(plan_memory) plan_network_memory(net);
     if(clear) (*net->seen) = 0;
     return net;
 }
@@ -185,6 +189,26 @@ network *make_network(int n)
     return net;
 }
 
+/* The cpu workspace is only allocated once a pass needs it: inference with
+ * implicit convolutions needs none or a fused pool band, training needs the
+ * largest layer's */
+static void reserve_workspace(network *net)
+{
+    size_t size = 0;
+    int i;
+    for(i = 0; i < net->n; ++i){
+        layer l = net->layers[i];
+        size_t s = l.workspace_size;
+        if(l.type == CONVOLUTIONAL) s = net->train ? l.workspace_size : get_convolutional_forward_workspace(*net, i);
+        if(s > size) size = s;
+    }
+    if(size > net->workspace_size){
+        free(net->workspace);
+        net->workspace = calloc(1, size);
+        net->workspace_size = size;
+    }
+}
+
 void forward_network(network *netp)
 {
 #ifdef GPU
@@ -193,6 +217,7 @@ void forward_network(network *netp)
         return;
     }
 #endif
+    reserve_workspace(netp);
     network net = *netp;
     int i;
     for(i = 0; i < net.n; ++i){
@@ -201,7 +226,9 @@ void forward_network(network *netp)
         if(l.delta){
             fill_cpu(l.outputs * l.batch, 0, l.delta, 1);
         }
+        sim_roi_begin(get_layer_string(l.type));
         l.forward(l, net);
+        sim_roi_end();
         net.input = l.output;
         if(l.truth) {
             net.truth = l.output;
@@ -237,6 +264,10 @@ void update_network(network *netp)
         if(l.update){
             l.update(l, a);
         }
+        // transformed, folded and quantized weights would be stale now
+        netp->layers[i].winograd = 0;
+        netp->layers[i].folded = 0;
+        netp->layers[i].quantized = 0;
     }
 }
 
@@ -289,6 +320,8 @@ void backward_network(network *netp)
 float train_network_datum(network *net)
 {
     *net->seen += net->batch;
+    if(net->weights_map) error("Weights mapped from a packed file are read only, train from a .weights file");
+    if(net->arena) unplan_network_memory(net);
     net->train = 1;
     forward_network(net);
     backward_network(net);
@@ -362,6 +395,8 @@ int resize_network(network *net, int w, int h)
     cuda_free(net->workspace);
 #endif
     int i;
+    int planned = net->arena != 0;
+    if(planned) unplan_network_memory(net);
     //if(w == net->w && h == net->h) return 0;
     net->w = w;
     net->h = h;
@@ -427,12 +462,15 @@ int resize_network(network *net, int w, int h)
         }
     }else {
         free(net->workspace);
-        net->workspace = calloc(1, workspace_size);
+        net->workspace = 0;
+        net->workspace_size = 0;
     }
 #else
     free(net->workspace);
-    net->workspace = calloc(1, workspace_size);
+    net->workspace = 0;
+    net->workspace_size = 0;
 #endif
+    if(planned) plan_network_memory(net);
     //fprintf(stderr, " Done!\n");
     return 0;
 }
@@ -503,6 +541,8 @@ float *network_predict(network *net, float *input)
     net->delta = 0;
     forward_network(net);
     float *out = net->output;
+    orig.workspace = net->workspace;
+    orig.workspace_size = net->workspace_size;
     *net = orig;
     return out;
 }
@@ -716,6 +756,8 @@ float network_accuracy_multi(network *net, data d, int n)
 void free_network(network *net)
 {
     int i;
+    if(net->arena) free_network_arena(net);
+    if(net->weights_map) free_weights_map(net);
     for(i = 0; i < net->n; ++i){
         free_layer(net->layers[i]);
     }
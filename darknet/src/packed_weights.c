@@ -0,0 +1,252 @@
+#include "packed_weights.h"
+#include "convolutional_layer.h"
+#include "connected_layer.h"
+#include "batchnorm_layer.h"
+#include "winograd.h"
+#include "gemm.h"
+#include "utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/*
+ * Packed weight files, written by save_packed_weights ("darknet pack").
+ *
+ * A header, a table of tensors, then the tensors, each 64 byte aligned. The
+ * tensors are the layer arrays as they are in memory after load_weights:
+ * connected weights already transposed, batchnorm folded, and for every
+ * convolutional layer the filters both as they are and as pack_gemm_a panels
+ * for the sgemm kernel named in the header, plus the transformed filters of
+ * layers that run Winograd. load_weights recognizes the file by its magic and
+ * maps it read only. The layer arrays then point straight into the mapping,
+ * so loading copies nothing, and processes running the same file share its
+ * pages. If this machine picks another sgemm kernel the panels and Winograd
+ * filters are skipped and the layers prepared as for a .weights file.
+ * Mapped weights can not be trained.
+ */
+
+#define PACKED_MAGIC "dnpacked"
+#define PACKED_VERSION 1
+#define PACKED_ALIGN 64
+
+enum{
+    PACKED_WEIGHTS,
+    PACKED_BIASES,
+    PACKED_SCALES,
+    PACKED_ROLLING_MEAN,
+    PACKED_ROLLING_VARIANCE,
+    PACKED_FOLDED_SCALES,
+    PACKED_FOLDED_BIASES,
+    PACKED_PANELS,
+    PACKED_WINOGRAD,
+    PACKED_KINDS
+};
+
+typedef struct{
+    char magic[8];
+    int32_t version;
+    int32_t tensors;
+    char kernel[16];
+    uint64_t seen;
+} packed_header;
+
+/* arg is the Winograd tile size m of PACKED_WINOGRAD */
+typedef struct{
+    int32_t layer;
+    int32_t kind;
+    int32_t arg;
+    int32_t pad;
+    uint64_t offset;
+    uint64_t count;
+} packed_tensor;
+
+static float **packed_field(layer *l, int kind)
+{
+    switch(kind){
+        case PACKED_WEIGHTS: return &l->weights;
+        case PACKED_BIASES: return &l->biases;
+        case PACKED_SCALES: return &l->scales;
+        case PACKED_ROLLING_MEAN: return &l->rolling_mean;
+        case PACKED_ROLLING_VARIANCE: return &l->rolling_variance;
+        case PACKED_FOLDED_SCALES: return &l->folded_scales;
+        case PACKED_FOLDED_BIASES: return &l->folded_biases;
+        case PACKED_PANELS: return &l->packed_weights;
+        case PACKED_WINOGRAD: return &l->winograd_weights;
+    }
+    return 0;
+}
+
+static size_t panel_size(layer l)
+{
+    int m = l.n/l.groups;
+    int k = l.size*l.size*l.c/l.groups;
+    return pack_gemm_a(m, k, 1, 0, k, 0);
+}
+
+/* Floats a tensor of this kind takes in layer l, 0 if the layer has none */
+static size_t packed_count(layer l, int kind, int arg)
+{
+    const int conv = l.type == CONVOLUTIONAL;
+    const int bn = l.batch_normalize || l.type == BATCHNORM;
+    const int n = conv ? l.n : (l.type == CONNECTED) ? l.outputs : l.c;
+    if(!conv && l.type != CONNECTED && l.type != BATCHNORM) return 0;
+    switch(kind){
+        case PACKED_WEIGHTS: return conv ? (size_t)l.nweights : (l.type == CONNECTED) ? (size_t)l.inputs*l.outputs : 0;
+        case PACKED_BIASES: return (l.type != BATCHNORM) ? n : 0;
+        case PACKED_SCALES:
+        case PACKED_ROLLING_MEAN:
+        case PACKED_ROLLING_VARIANCE: return bn ? n : 0;
+        case PACKED_FOLDED_SCALES:
+        case PACKED_FOLDED_BIASES: return (conv && l.batch_normalize) ? n : 0;
+        case PACKED_PANELS: return (conv && !l.xnor && !l.binary) ? l.groups*panel_size(l) : 0;
+        case PACKED_WINOGRAD: return (conv && arg) ? (size_t)(arg + 2)*(arg + 2)*pack_gemm_a(l.n, l.c, 1, 0, l.c, 0) : 0;
+    }
+    return 0;
+}
+
+static uint64_t packed_align(uint64_t n)
+{
+    return (n + PACKED_ALIGN - 1)/PACKED_ALIGN*PACKED_ALIGN;
+}
+
+void save_packed_weights(network *net, char *filename)
+{
+    fprintf(stderr, "Saving packed weights to %s\n", filename);
+    FILE *fp = fopen(filename, "wb");
+    if(!fp) file_error(filename);
+
+    packed_tensor *t = calloc(PACKED_KINDS*net->n, sizeof(packed_tensor));
+    int n = 0;
+    int i, kind, g;
+    for(i = 0; i < net->n; ++i){
+        layer *l = &net->layers[i];
+        if(l->type == DECONVOLUTIONAL || l->type == LOCAL || l->type == RNN || l->type == GRU || l->type == LSTM || l->type == CRNN){
+            error("Packed weights only hold convolutional, connected and batchnorm layers");
+        }
+        if(l->type == CONVOLUTIONAL && l->batch_normalize && !l->folded) fold_convolutional_batchnorm(l);
+        for(kind = 0; kind < PACKED_KINDS; ++kind){
+            int arg = (kind == PACKED_WINOGRAD && l->winograd_weights) ? l->winograd : 0;
+            size_t count = packed_count(*l, kind, arg);
+            if(!count) continue;
+            packed_tensor e = {i, kind, arg, 0, 0, count};
+            t[n++] = e;
+        }
+    }
+
+    uint64_t offset = packed_align(sizeof(packed_header) + n*sizeof(packed_tensor));
+    for(i = 0; i < n; ++i){
+        t[i].offset = offset;
+        offset += packed_align(t[i].count*sizeof(float));
+    }
+    packed_header h = {{0}};
+    memcpy(h.magic, PACKED_MAGIC, sizeof(h.magic));
+    h.version = PACKED_VERSION;
+    h.tensors = n;
+    strncpy(h.kernel, sgemm_kernel_name(), sizeof(h.kernel) - 1);
+    h.seen = *net->seen;
+    fwrite(&h, sizeof(h), 1, fp);
+    fwrite(t, sizeof(packed_tensor), n, fp);
+
+    static const char zeros[PACKED_ALIGN] = {0};
+    for(i = 0; i < n; ++i){
+        layer *l = &net->layers[t[i].layer];
+        float *data = *packed_field(l, t[i].kind);
+        if(t[i].kind == PACKED_PANELS){
+            int m = l->n/l->groups;
+            int k = l->size*l->size*l->c/l->groups;
+            data = calloc(t[i].count, sizeof(float));
+            for(g = 0; g < l->groups; ++g){
+                pack_gemm_a(m, k, 1, l->weights + g*l->nweights/l->groups, k, data + g*panel_size(*l));
+            }
+        }
+        fwrite(zeros, 1, t[i].offset - ftell(fp), fp);
+        fwrite(data, sizeof(float), t[i].count, fp);
+        if(t[i].kind == PACKED_PANELS) free(data);
+    }
+    fclose(fp);
+    free(t);
+}
+
+int is_packed_weights(char *filename)
+{
+    char magic[8] = {0};
+    FILE *fp = fopen(filename, "rb");
+    if(!fp) return 0;
+    int n = fread(magic, 1, sizeof(magic), fp);
+    fclose(fp);
+    return n == sizeof(magic) && !memcmp(magic, PACKED_MAGIC, sizeof(magic));
+}
+
+void load_packed_weights(network *net, char *filename)
+{
+    fprintf(stderr, "Mapping packed weights from %s...", filename);
+    int fd = open(filename, O_RDONLY);
+    if(fd < 0) file_error(filename);
+    struct stat st;
+    if(fstat(fd, &st)) file_error(filename);
+    size_t size = st.st_size;
+    char *map = mmap(0, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(map == MAP_FAILED) file_error(filename);
+
+    const packed_header *h = (const packed_header *)map;
+    if(size < sizeof(packed_header) || memcmp(h->magic, PACKED_MAGIC, sizeof(h->magic)) || h->version != PACKED_VERSION){
+        error("Not a packed weight file of this version");
+    }
+    const packed_tensor *t = (const packed_tensor *)(h + 1);
+    if(sizeof(packed_header) + h->tensors*sizeof(packed_tensor) > size) error("Packed weight file is truncated");
+    int same_kernel = !strncmp(h->kernel, sgemm_kernel_name(), sizeof(h->kernel));
+    *net->seen = h->seen;
+
+    int i;
+    for(i = 0; i < h->tensors; ++i){
+        packed_tensor e = t[i];
+        if(e.layer < 0 || e.layer >= net->n || e.kind < 0 || e.kind >= PACKED_KINDS) error("Packed weights do not match the network");
+        layer *l = &net->layers[e.layer];
+        if((e.kind == PACKED_PANELS || e.kind == PACKED_WINOGRAD) && !same_kernel) continue;
+        if(packed_count(*l, e.kind, e.arg) != e.count || e.offset + e.count*sizeof(float) > size){
+            error("Packed weights do not match the network");
+        }
+        float **field = packed_field(l, e.kind);
+        free(*field);
+        *field = (float *)(map + e.offset);
+        if(e.kind == PACKED_FOLDED_BIASES) l->folded = 1;
+        if(e.kind == PACKED_WINOGRAD) l->winograd = e.arg;
+    }
+    for(i = 0; i < net->n; ++i){
+        layer *l = &net->layers[i];
+        if(l->type == CONVOLUTIONAL && !same_kernel) prepare_winograd_layer(l);
+#ifdef GPU
+        if(gpu_index >= 0){
+            if(l->type == CONVOLUTIONAL) push_convolutional_layer(*l);
+            if(l->type == CONNECTED) push_connected_layer(*l);
+            if(l->type == BATCHNORM) push_batchnorm_layer(*l);
+        }
+#endif
+    }
+    net->weights_map = map;
+    net->weights_map_size = size;
+    fprintf(stderr, "Done!\n");
+    if(!same_kernel) fprintf(stderr, "Packed for the %.16s sgemm kernel, not %s, packing at load instead\n", h->kernel, sgemm_kernel_name());
+}
+
+void free_weights_map(network *net)
+{
+    char *map = net->weights_map;
+    int i, kind;
+    for(i = 0; i < net->n; ++i){
+        layer *l = &net->layers[i];
+        for(kind = 0; kind < PACKED_KINDS; ++kind){
+            float **field = packed_field(l, kind);
+            if((char *)*field >= map && (char *)*field < map + net->weights_map_size) *field = 0;
+        }
+    }
+    munmap(net->weights_map, net->weights_map_size);
+    net->weights_map = 0;
+    net->weights_map_size = 0;
+}
@@ -0,0 +1,10 @@
+#ifndef PACKED_WEIGHTS_H
+#define PACKED_WEIGHTS_H
+
+#include "darknet.h"
+
+int is_packed_weights(char *filename);
+void load_packed_weights(network *net, char *filename);
+void free_weights_map(network *net);
+
+#endif
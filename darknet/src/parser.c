@@ -25,6 +25,7 @@
 #include "normalization_layer.h"
 #include "option_list.h"
 #include "parser.h"
+#include "winograd.h"
 #include "region_layer.h"
 #include "yolo_layer.h"
 #include "iseg_layer.h"
@@ -36,6 +37,7 @@
 #include "softmax_layer.h"
 #include "lstm_layer.h"
 #include "utils.h"
+#include "packed_weights.h"
 
 typedef struct{
     char *type;
@@ -873,18 +875,12 @@ network *parse_network_cfg(char *filename)
     net->input_gpu = cuda_make_array(net->input, net->inputs*net->batch);
     net->truth_gpu = cuda_make_array(net->truth, net->truths*net->batch);
 #endif
-    if(workspace_size){
-        //printf("%ld\n", workspace_size);
+    // the cpu workspace is allocated by forward_network once a pass needs it
 #ifdef GPU
-        if(gpu_index >= 0){
-            net->workspace = cuda_make_array(0, (workspace_size-1)/sizeof(float)+1);
-        }else {
-            net->workspace = calloc(1, workspace_size);
-        }
-#else
-        net->workspace = calloc(1, workspace_size);
-#endif
+    if(workspace_size && gpu_index >= 0){
+        net->workspace = cuda_make_array(0, (workspace_size-1)/sizeof(float)+1);
     }
+#endif
     return net;
 }
 
@@ -1249,6 +1245,10 @@ void load_weights_upto(network *net, char *filename, int start, int cutoff)
         if(l.type == CONVOLUTIONAL || l.type == DECONVOLUTIONAL){
             load_convolutional_weights(l, fp);
         }
+        if(l.type == CONVOLUTIONAL){
+            fold_convolutional_batchnorm(&net->layers[i]);
+            prepare_winograd_layer(&net->layers[i]);
+        }
         if(l.type == CONNECTED){
             load_connected_weights(l, fp, transpose);
         }
@@ -1307,6 +1307,7 @@ void load_weights_upto(network *net, char *filename, int start, int cutoff)
 
 void load_weights(network *net, char *filename)
 {
-    load_weights_upto(net, filename, 0, net->n);
+    if(is_packed_weights(filename)) load_packed_weights(net, filename);
+    else load_weights_upto(net, filename, 0, net->n);
 }
 
@@ -0,0 +1,375 @@
+#include "gemm.h"
+#include "threadpool.h"
+#include "darknet.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define QGEMM_X86
+#include <immintrin.h>
+#endif
+
+/*
+ * Int8 GEMM for quantized inference.
+ *
+ * Weights are signed bytes, quantized and packed once at load time into
+ * QGEMM_MR tall panels that hold 4 consecutive k of a row in one 32 bit word.
+ * Activations are quantized symmetrically to [-127, 127] and stored offset by
+ * 128 as unsigned bytes, packed into NR wide panels with the same 4 k per
+ * word. One vpmaddubsw + vpmaddwd pair (AVX2) or one vpdpbusd (AVX-512 VNNI)
+ * then adds the 4 products of a row and a column into an int32 lane, and the
+ * offset comes back out per row as 128*sum(w) before the result is scaled to
+ * float, biased and activated while it is written.
+ *
+ * vpmaddubsw sums two u8*s8 products into a saturating int16, which cannot
+ * overflow for |w| <= 64, so the AVX2 kernel wants weights in [-63, 63];
+ * qgemm_weight_max() tells the quantizer which range the kernel takes.
+ */
+
+#define QGEMM_MR 4
+#define QGEMM_MAX_NR 32
+#define QGEMM_B_BYTES (256*1024)
+
+typedef void (*qgemm_micro)(int k4, const signed char *a, const unsigned char *b, int *c);
+
+typedef struct{
+    const char *name;
+    int nr;
+    int weight_max;
+    qgemm_micro kernel;
+} qgemm_kernel;
+
+/* c (QGEMM_MR x 16) = a * b over k4 words */
+static void qgemm_micro_scalar(int k4, const signed char *a, const unsigned char *b, int *c)
+{
+    int p, i, j, q;
+    memset(c, 0, QGEMM_MR*16*sizeof(int));
+    for(p = 0; p < k4; ++p){
+        for(i = 0; i < QGEMM_MR; ++i){
+            for(j = 0; j < 16; ++j){
+                int sum = 0;
+                for(q = 0; q < 4; ++q) sum += a[i*4 + q]*b[j*4 + q];
+                c[i*16 + j] += sum;
+            }
+        }
+        a += QGEMM_MR*4;
+        b += 16*4;
+    }
+}
+
+#ifdef QGEMM_X86
+
+static inline int qgemm_word(const signed char *a)
+{
+    int w;
+    memcpy(&w, a, sizeof(w));
+    return w;
+}
+
+__attribute__((target("avx2")))
+static void qgemm_micro_avx2(int k4, const signed char *a, const unsigned char *b, int *c)
+{
+    const __m256i ones = _mm256_set1_epi16(1);
+    __m256i acc[QGEMM_MR][2];
+    int p, i;
+    for(i = 0; i < QGEMM_MR; ++i){
+        acc[i][0] = _mm256_setzero_si256();
+        acc[i][1] = _mm256_setzero_si256();
+    }
+    for(p = 0; p < k4; ++p){
+        __m256i b0 = _mm256_load_si256((const __m256i *)b);
+        __m256i b1 = _mm256_load_si256((const __m256i *)(b + 32));
+        for(i = 0; i < QGEMM_MR; ++i){
+            __m256i ai = _mm256_set1_epi32(qgemm_word(a + i*4));
+            acc[i][0] = _mm256_add_epi32(acc[i][0], _mm256_madd_epi16(_mm256_maddubs_epi16(b0, ai), ones));
+            acc[i][1] = _mm256_add_epi32(acc[i][1], _mm256_madd_epi16(_mm256_maddubs_epi16(b1, ai), ones));
+        }
+        a += QGEMM_MR*4;
+        b += 16*4;
+    }
+    for(i = 0; i < QGEMM_MR; ++i){
+        _mm256_storeu_si256((__m256i *)(c + i*16), acc[i][0]);
+        _mm256_storeu_si256((__m256i *)(c + i*16 + 8), acc[i][1]);
+    }
+}
+
+__attribute__((target("avx512f,avx512vnni")))
+static void qgemm_micro_vnni(int k4, const signed char *a, const unsigned char *b, int *c)
+{
+    __m512i acc[QGEMM_MR][2];
+    int p, i;
+    for(i = 0; i < QGEMM_MR; ++i){
+        acc[i][0] = _mm512_setzero_si512();
+        acc[i][1] = _mm512_setzero_si512();
+    }
+    for(p = 0; p < k4; ++p){
+        __m512i b0 = _mm512_load_si512((const void *)b);
+        __m512i b1 = _mm512_load_si512((const void *)(b + 64));
+        for(i = 0; i < QGEMM_MR; ++i){
+            __m512i ai = _mm512_set1_epi32(qgemm_word(a + i*4));
+            acc[i][0] = _mm512_dpbusd_epi32(acc[i][0], b0, ai);
+            acc[i][1] = _mm512_dpbusd_epi32(acc[i][1], b1, ai);
+        }
+        a += QGEMM_MR*4;
+        b += 32*4;
+    }
+    for(i = 0; i < QGEMM_MR; ++i){
+        _mm512_storeu_si512((void *)(c + i*32), acc[i][0]);
+        _mm512_storeu_si512((void *)(c + i*32 + 16), acc[i][1]);
+    }
+}
+
+#endif
+
+static const qgemm_kernel qgemm_scalar = {"scalar", 16, 127, qgemm_micro_scalar};
+#ifdef QGEMM_X86
+static const qgemm_kernel qgemm_avx2 = {"avx2", 16, 63, qgemm_micro_avx2};
+static const qgemm_kernel qgemm_vnni = {"vnni", 32, 127, qgemm_micro_vnni};
+#endif
+
+static const qgemm_kernel *qselected = 0;
+
+static const qgemm_kernel *qgemm_select()
+{
+    if(qselected) return qselected;
+    qselected = &qgemm_scalar;
+#ifdef QGEMM_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx512vnni")) qselected = &qgemm_vnni;
+    else if(__builtin_cpu_supports("avx2")) qselected = &qgemm_avx2;
+#endif
+    return qselected;
+}
+
+const char *qgemm_kernel_name()
+{
+    return qgemm_select()->name;
+}
+
+/* Same as sgemm_set_kernel, must be called before weights are quantized
+ * since the kernel decides their range */
+int qgemm_set_kernel(const char *name)
+{
+    if(0 == strcmp(name, "scalar")){
+        qselected = &qgemm_scalar;
+        return 1;
+    }
+#ifdef QGEMM_X86
+    __builtin_cpu_init();
+    if(0 == strcmp(name, "avx2") && __builtin_cpu_supports("avx2")){
+        qselected = &qgemm_avx2;
+        return 1;
+    }
+    if(0 == strcmp(name, "vnni") && __builtin_cpu_supports("avx512vnni")){
+        qselected = &qgemm_vnni;
+        return 1;
+    }
+#endif
+    return 0;
+}
+
+int qgemm_weight_max()
+{
+    return qgemm_select()->weight_max;
+}
+
+/* q = round(x/scale) clamped to [-127, 127], stored + 128 */
+void quantize_u8(const float *x, int n, float scale, unsigned char *q)
+{
+    const float inv = 1/scale;
+    int i;
+    for(i = 0; i < n; ++i){
+        float v = x[i]*inv;
+        v = (v > 127) ? 127 : (v < -127) ? -127 : v;
+        q[i] = (unsigned char)(int)(v + 128.5f);
+    }
+}
+
+/* A (M x K) row major into QGEMM_MR tall panels of K rounded up to 4, zero
+ * padded. Returns the bytes it takes, with packed 0 it only computes that. */
+size_t pack_qgemm_a(int M, int K, const signed char *A, signed char *packed)
+{
+    const int k4 = (K + 3)/4;
+    const int panels = (M + QGEMM_MR - 1)/QGEMM_MR;
+    int r, p, i, q;
+    for(r = 0; packed && r < panels; ++r){
+        for(p = 0; p < k4; ++p){
+            for(i = 0; i < QGEMM_MR; ++i){
+                int row = r*QGEMM_MR + i;
+                for(q = 0; q < 4; ++q){
+                    int k = p*4 + q;
+                    *packed++ = (row < M && k < K) ? A[(size_t)row*K + k] : 0;
+                }
+            }
+        }
+    }
+    return (size_t)panels*QGEMM_MR*k4*4;
+}
+
+/* Four k of an nr wide panel whose columns are consecutive pixels of one
+ * output row, stride 1 and all inside the image: each k is then a run of nr
+ * bytes of the image. Returns 0 if that does not hold. */
+static int pack_qgemm_run(const qgemm_b *b, int K, int k, int ih0, int iw0, int nr, unsigned char *packed)
+{
+    const unsigned char *src[4];
+    int q, r;
+    if(k + 4 > K) return 0;
+    for(q = 0; q < 4; ++q){
+        int kw = (k + q) % b->ksize;
+        int kh = (k + q) / b->ksize % b->ksize;
+        int ih = ih0 + kh, iw = iw0 + kw;
+        if(ih < 0 || iw < 0 || ih >= b->height || iw + nr > b->width) return 0;
+        src[q] = b->im + (size_t)((k + q) / b->ksize / b->ksize)*b->height*b->width + ih*b->width + iw;
+    }
+    for(r = 0; r < nr; ++r){
+        packed[r*4 + 0] = src[0][r];
+        packed[r*4 + 1] = src[1][r];
+        packed[r*4 + 2] = src[2][r];
+        packed[r*4 + 3] = src[3][r];
+    }
+    return 1;
+}
+
+/* Columns [jc, jc + nc) of op(B) into nr wide panels of k4 words. Padding
+ * takes the zero point, 128, so it adds nothing. */
+static void pack_qgemm_b(const qgemm_b *b, int K, int jc, int nc, int nr, unsigned char *packed)
+{
+    const int k4 = (K + 3)/4;
+    int ih0[QGEMM_MAX_NR], iw0[QGEMM_MAX_NR];
+    int j, p, r, q;
+    for(j = 0; j < nc; j += nr){
+        int cols = (nc - j < nr) ? nc - j : nr;
+        int run = b->im && b->stride == 1 && cols == nr && (jc + j)/b->out_w == (jc + j + nr - 1)/b->out_w;
+        for(r = 0; b->im && r < cols; ++r){
+            int out = jc + j + r;
+            ih0[r] = (out / b->out_w)*b->stride - b->pad;
+            iw0[r] = (out % b->out_w)*b->stride - b->pad;
+        }
+        for(p = 0; p < k4; ++p, packed += nr*4){
+            if(run && pack_qgemm_run(b, K, p*4, ih0[0], iw0[0], nr, packed)) continue;
+            for(q = 0; q < 4; ++q){
+                int k = p*4 + q;
+                unsigned char *dst = packed + q;
+                if(k >= K){
+                    for(r = 0; r < nr; ++r) dst[r*4] = 128;
+                } else if(b->im){
+                    int kw = k % b->ksize;
+                    int kh = k / b->ksize % b->ksize;
+                    const unsigned char *channel = b->im + (size_t)(k / b->ksize / b->ksize)*b->height*b->width;
+                    for(r = 0; r < cols; ++r){
+                        int ih = ih0[r] + kh;
+                        int iw = iw0[r] + kw;
+                        dst[r*4] = (ih < 0 || iw < 0 || ih >= b->height || iw >= b->width) ? 128 : channel[ih*b->width + iw];
+                    }
+                    for(; r < nr; ++r) dst[r*4] = 128;
+                } else {
+                    const unsigned char *row = b->B + (size_t)k*b->rs + (size_t)(jc + j)*b->cs;
+                    for(r = 0; r < cols; ++r) dst[r*4] = row[r*b->cs];
+                    for(; r < nr; ++r) dst[r*4] = 128;
+                }
+            }
+        }
+    }
+}
+
+static void *qgemm_alloc(size_t n)
+{
+    void *p = 0;
+    if(posix_memalign(&p, 64, n)){
+        fprintf(stderr, "qgemm: could not allocate %lu bytes\n", (unsigned long)n);
+        exit(-1);
+    }
+    return p;
+}
+
+/* One block of B panels and the whole of A, shared by the chunks
+ * parallel_for hands out */
+typedef struct{
+    const qgemm_kernel *k;
+    const qgemm_b *b;
+    int M, K, jc, nb;
+    const signed char *packed_a;
+    const int *offsets;
+    unsigned char *packed_b;
+    float *C;
+    int rs, cs;
+    const gemm_epilogue *ep;
+} qgemm_block;
+
+/* a chunk is a run of nr wide panels */
+static void qgemm_pack_panels(void *arg, int begin, int end)
+{
+    qgemm_block *t = arg;
+    const int nr = t->k->nr, k4 = (t->K + 3)/4;
+    int j = begin*nr;
+    int cols = (end*nr < t->nb) ? end*nr - j : t->nb - j;
+    pack_qgemm_b(t->b, t->K, t->jc + j, cols, nr, t->packed_b + (size_t)j*k4*4);
+}
+
+/* a chunk is a run of MR tall panels of A */
+static void qgemm_panels(void *arg, int begin, int end)
+{
+    qgemm_block *t = arg;
+    const int nr = t->k->nr, k4 = (t->K + 3)/4;
+    const gemm_epilogue *ep = t->ep;
+    int tile[QGEMM_MR*QGEMM_MAX_NR];
+    int ir, jr, i, j;
+    for(ir = begin*QGEMM_MR; ir < end*QGEMM_MR; ir += QGEMM_MR){
+        const signed char *ap = t->packed_a + (size_t)ir*k4*4;
+        int rows = (t->M - ir < QGEMM_MR) ? t->M - ir : QGEMM_MR;
+        for(jr = 0; jr < t->nb; jr += nr){
+            int cols = (t->nb - jr < nr) ? t->nb - jr : nr;
+            t->k->kernel(k4, ap, t->packed_b + (size_t)jr*k4*4, tile);
+            for(i = 0; i < rows; ++i){
+                const float scale = ep->scales[ir + i];
+                const float bias = ep->biases ? ep->biases[ir + i] : 0;
+                const int offset = t->offsets[ir + i];
+                float *c = t->C + (size_t)(ir + i)*t->rs + (size_t)(t->jc + jr)*t->cs;
+                for(j = 0; j < cols; ++j){
+                    float v = (tile[i*nr + j] - offset)*scale + bias;
+                    if(ep->activation == LEAKY) v = (v > 0) ? v : .1f*v;
+                    else if(ep->activation == RELU) v = (v > 0) ? v : 0;
+                    c[j*t->cs] = v;
+                }
+            }
+        }
+    }
+}
+
+/* C[i*rs + j*cs] = activation(scales[i]*(A*op(B) - offsets[i]) + biases[i])
+ * for the packed A from pack_qgemm_a, offsets[i] = 128*sum(A[i]) */
+void qgemm(int M, int N, int K,
+        const signed char *packed_a, const int *offsets,
+        const qgemm_b *b,
+        float *C, int rs, int cs,
+        const gemm_epilogue *ep)
+{
+    const qgemm_kernel *k = qgemm_select();
+    const int nr = k->nr, k4 = (K + 3)/4;
+    if(M <= 0 || N <= 0 || K <= 0) return;
+
+    /* every A panel streams over a block of B panels that stays in L2 */
+    int nc = QGEMM_B_BYTES/(k4*4)/nr*nr;
+    if(nc < nr) nc = nr;
+    if(nc > (N + nr - 1)/nr*nr) nc = (N + nr - 1)/nr*nr;
+
+    qgemm_block t = {0};
+    t.k = k;
+    t.b = b;
+    t.M = M;
+    t.K = K;
+    t.packed_a = packed_a;
+    t.offsets = offsets;
+    t.packed_b = qgemm_alloc((size_t)nc*k4*4);
+    t.C = C;
+    t.rs = rs;
+    t.cs = cs;
+    t.ep = ep;
+    for(t.jc = 0; t.jc < N; t.jc += nc){
+        t.nb = (N - t.jc < nc) ? N - t.jc : nc;
+        parallel_for((t.nb + nr - 1)/nr, 4, qgemm_pack_panels, &t);
+        parallel_for((M + QGEMM_MR - 1)/QGEMM_MR, 1, qgemm_panels, &t);
+    }
+    free(t.packed_b);
+}
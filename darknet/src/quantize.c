@@ -0,0 +1,233 @@
+#include "quantize.h"
+#include "gemm.h"
+#include "network.h"
+#include "activations.h"
+#include "image.h"
+#include "utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+/*
+ * Int8 inference for convolutional and connected layers.
+ *
+ * Weights are quantized per output channel, symmetric, with the scale
+ * max|w|/qgemm_weight_max(). A layer's input is quantized per tensor with a
+ * scale calibrated offline as max|x|/127 over a set of images and kept in a
+ * text file of "layer scale" lines. The int8 GEMM turns the int32 sums back
+ * into floats with input scale * weight scale * folded batchnorm scale, adds
+ * the bias and applies the activation as it writes the output. Outputs stay
+ * fp32, so every layer that is not quantized runs unchanged.
+ */
+
+int int8_inference = 0;
+char *int8_calibration = 0;
+
+static int int8_activation(ACTIVATION a)
+{
+    return a == LINEAR || a == LEAKY || a == RELU;
+}
+
+int quantizable_layer(layer l)
+{
+    if(l.type == CONVOLUTIONAL) return l.groups == 1 && !l.xnor && !l.binary && (!l.batch_normalize || l.folded);
+    if(l.type == CONNECTED) return !l.batch_normalize;
+    return 0;
+}
+
+void quantize_layer(layer *l, float input_scale)
+{
+    const int M = (l->type == CONNECTED) ? l->outputs : l->n;
+    const int K = (l->type == CONNECTED) ? l->inputs : l->size*l->size*l->c;
+    const int wmax = qgemm_weight_max();
+    signed char *q = calloc((size_t)M*K, sizeof(signed char));
+    if(!l->qoffsets) l->qoffsets = calloc(M, sizeof(int));
+    if(!l->qscales) l->qscales = calloc(M, sizeof(float));
+
+    int i, k;
+    for(i = 0; i < M; ++i){
+        const float *w = l->weights + (size_t)i*K;
+        float big = 0;
+        for(k = 0; k < K; ++k) if(fabs(w[k]) > big) big = fabs(w[k]);
+        float scale = (big > 0) ? big/wmax : 1;
+        int sum = 0;
+        for(k = 0; k < K; ++k){
+            int v = (int)roundf(w[k]/scale);
+            q[(size_t)i*K + k] = v;
+            sum += v;
+        }
+        l->qoffsets[i] = 128*sum;
+        l->qscales[i] = input_scale*scale*(l->batch_normalize ? l->folded_scales[i] : 1);
+    }
+    free(l->qweights);
+    l->qweights = malloc(pack_qgemm_a(M, K, 0, 0));
+    pack_qgemm_a(M, K, q, l->qweights);
+    free(q);
+    l->input_scale = input_scale;
+    l->quantized = 1;
+}
+
+int use_int8(layer l, network net)
+{
+    return int8_inference && l.quantized && !net.train;
+}
+
+void forward_int8_layer(layer l, network net)
+{
+    const int conv = l.type == CONVOLUTIONAL;
+    const int M = conv ? l.n : l.outputs;
+    const int K = conv ? l.size*l.size*l.c : l.inputs;
+    unsigned char *q = malloc((size_t)l.inputs*l.batch);
+    quantize_u8(net.input, l.inputs*l.batch, l.input_scale, q);
+
+    gemm_epilogue ep = {0};
+    ep.scales = l.qscales;
+    ep.biases = (conv && l.batch_normalize) ? l.folded_biases : l.biases;
+    ep.activation = int8_activation(l.activation) ? l.activation : LINEAR;
+
+    qgemm_b b = {0};
+    int i;
+    if(conv){
+        const int N = l.out_h*l.out_w;
+        b.channels = l.c;
+        b.height = l.h;
+        b.width = l.w;
+        b.ksize = l.size;
+        b.stride = l.stride;
+        b.pad = l.pad;
+        b.out_w = l.out_w;
+        for(i = 0; i < l.batch; ++i){
+            b.im = q + (size_t)i*l.inputs;
+            qgemm(M, N, K, l.qweights, l.qoffsets, &b, l.output + (size_t)i*l.outputs, N, 1, &ep);
+        }
+    } else {
+        /* columns are the batch, written transposed into output[batch][outputs] */
+        b.B = q;
+        b.rs = 1;
+        b.cs = l.inputs;
+        qgemm(M, l.batch, K, l.qweights, l.qoffsets, &b, l.output, 1, l.outputs, &ep);
+    }
+    if(!int8_activation(l.activation)) activate_array(l.output, l.outputs*l.batch, l.activation);
+    free(q);
+}
+
+static image load_calibration_image(network *net, char *path)
+{
+    image im = load_image_color(path, 0, 0);
+    image sized = letterbox_image(im, net->w, net->h);
+    free_image(im);
+    return sized;
+}
+
+void calibrate_int8(network *net, char **paths, int n, char *filename)
+{
+    float *big = calloc(net->n, sizeof(float));
+    int saved = int8_inference;
+    int i, j, k;
+    int8_inference = 0;
+    unplan_network_memory(net);
+    set_batch_network(net, 1);
+    for(i = 0; i < n; ++i){
+        image im = load_calibration_image(net, paths[i]);
+        network_predict(net, im.data);
+        for(j = 0; j < net->n; ++j){
+            layer l = net->layers[j];
+            if(!quantizable_layer(l)) continue;
+            float *x = j ? net->layers[j-1].output : im.data;
+            for(k = 0; k < l.inputs; ++k) if(fabs(x[k]) > big[j]) big[j] = fabs(x[k]);
+        }
+        free_image(im);
+    }
+    int8_inference = saved;
+
+    FILE *fp = fopen(filename, "w");
+    if(!fp) file_error(filename);
+    fprintf(fp, "# layer input_scale, max |input|/127 over %d images\n", n);
+    for(j = 0; j < net->n; ++j){
+        if(big[j] > 0) fprintf(fp, "%d %.9g\n", j, big[j]/127);
+    }
+    fclose(fp);
+    free(big);
+    fprintf(stderr, "Wrote int8 calibration of %d images to %s\n", n, filename);
+}
+
+int load_int8_calibration(network *net, char *filename)
+{
+    FILE *fp = fopen(filename, "r");
+    if(!fp) file_error(filename);
+    char *line;
+    int count = 0;
+    while((line = fgetl(fp)) != 0){
+        int index;
+        float scale;
+        if(line[0] != '#' && sscanf(line, "%d %f", &index, &scale) == 2 &&
+                index >= 0 && index < net->n && scale > 0 && quantizable_layer(net->layers[index])){
+            quantize_layer(&net->layers[index], scale);
+            ++count;
+        }
+        free(line);
+    }
+    fclose(fp);
+    int8_inference = 1;
+    fprintf(stderr, "Quantized %d layers to int8, %s kernel\n", count, qgemm_kernel_name());
+    return count;
+}
+
+/* Runs every image in fp32 and in int8 and prints, per layer, the signal to
+ * quantization noise ratio of its output, which includes the error carried
+ * in from the layers before it, plus the weight bytes and time per image */
+void int8_report(network *net, char **paths, int n)
+{
+    double *signal = calloc(net->n, sizeof(double));
+    double *noise = calloc(net->n, sizeof(double));
+    float **ref = calloc(net->n, sizeof(float *));
+    double fp32_time = 0, int8_time = 0;
+    int saved = int8_inference;
+    int i, j, k;
+    unplan_network_memory(net);
+    set_batch_network(net, 1);
+    for(j = 0; j < net->n; ++j) ref[j] = calloc(net->layers[j].outputs, sizeof(float));
+
+    for(i = 0; i < n; ++i){
+        image im = load_calibration_image(net, paths[i]);
+        double start = what_time_is_it_now();
+        int8_inference = 0;
+        network_predict(net, im.data);
+        fp32_time += what_time_is_it_now() - start;
+        for(j = 0; j < net->n; ++j){
+            layer l = net->layers[j];
+            for(k = 0; k < l.outputs; ++k) ref[j][k] = l.output[k];
+        }
+        start = what_time_is_it_now();
+        int8_inference = 1;
+        network_predict(net, im.data);
+        int8_time += what_time_is_it_now() - start;
+        for(j = 0; j < net->n; ++j){
+            layer l = net->layers[j];
+            for(k = 0; k < l.outputs; ++k){
+                double d = ref[j][k] - l.output[k];
+                signal[j] += (double)ref[j][k]*ref[j][k];
+                noise[j] += d*d;
+            }
+        }
+        free_image(im);
+    }
+    int8_inference = saved;
+
+    size_t fp32_bytes = 0, int8_bytes = 0;
+    printf("layer type           math  SQNR(dB)\n");
+    for(j = 0; j < net->n; ++j){
+        layer l = net->layers[j];
+        size_t weights = (l.type == CONVOLUTIONAL) ? (size_t)l.nweights : (l.type == CONNECTED) ? (size_t)l.inputs*l.outputs : 0;
+        fp32_bytes += weights*sizeof(float);
+        int8_bytes += l.quantized ? weights : weights*sizeof(float);
+        if(noise[j] > 0) printf("%5d %-14s %s  %8.2f\n", j, get_layer_string(l.type), l.quantized ? "int8" : "fp32", 10*log10(signal[j]/noise[j]));
+        else printf("%5d %-14s %s     exact\n", j, get_layer_string(l.type), l.quantized ? "int8" : "fp32");
+        free(ref[j]);
+    }
+    printf("weights: %.2f MB fp32, %.2f MB with int8 layers\n", fp32_bytes/1e6, int8_bytes/1e6);
+    printf("time per image: %.2f ms fp32, %.2f ms int8, %d images\n", 1e3*fp32_time/n, 1e3*int8_time/n, n);
+    free(ref);
+    free(signal);
+    free(noise);
+}
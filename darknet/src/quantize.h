@@ -0,0 +1,11 @@
+#ifndef QUANTIZE_H
+#define QUANTIZE_H
+
+#include "darknet.h"
+
+int quantizable_layer(layer l);
+void quantize_layer(layer *l, float input_scale);
+int use_int8(layer l, network net);
+void forward_int8_layer(layer l, network net);
+
+#endif
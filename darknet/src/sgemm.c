@@ -0,0 +1,548 @@
+#include "gemm.h"
+#include "threadpool.h"
+#include "darknet.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SGEMM_X86
+#include <immintrin.h>
+#endif
+
+/*
+ * Packed, cache blocked sgemm in the style of Goto/BLIS.
+ *
+ * C += ALPHA * op(A) * op(B) is split into NC wide column blocks of B and
+ * KC deep slices of K. Each KC x NC block of op(B) is packed into NR wide
+ * panels that stay in L2, each MC x KC block of op(A) (scaled by ALPHA) is
+ * packed into MR tall panels, and the micro-kernel computes an MR x NR tile
+ * of C in registers from one A panel and one B panel that stream through L1.
+ * Packing zero pads partial panels, so the kernels only ever see full tiles;
+ * edge tiles are computed into a small buffer and added to C. For a
+ * convolution the B panels are gathered straight from the input image
+ * (implicit GEMM), so the im2col matrix never exists in memory.
+ *
+ * With a gemm_epilogue the first KC slice overwrites C instead of adding to
+ * it and the last one applies the per row scale, bias and activation while
+ * the tile is still in registers, so a convolution's output is written once.
+ */
+
+/* How a micro-kernel writes its tile: 0 means C += tile, otherwise
+ * C = act(scale*(C + tile) + bias), with C only read if load is set */
+typedef struct{
+    int load;
+    const float *scales;
+    const float *biases;
+    ACTIVATION activation;
+} sgemm_store;
+
+typedef void (*sgemm_micro)(int k, const float *a, const float *b, float *c, int ldc, const sgemm_store *s);
+
+typedef struct{
+    const char *name;
+    int mr, nr;
+    int mc, kc, nc;
+    sgemm_micro kernel;
+} sgemm_kernel;
+
+#define SGEMM_MAX_TILE (8*32)
+#define SGEMM_MAX_NR 32
+
+/* Row i of a tile is row i of s->scales and s->biases */
+static inline float sgemm_finish(float v, const float *c, const sgemm_store *s, int i)
+{
+    if(s->load) v += *c;
+    if(s->scales) v *= s->scales[i];
+    if(s->biases) v += s->biases[i];
+    if(s->activation == LEAKY) return (v > 0) ? v : .1f*v;
+    if(s->activation == RELU) return (v > 0) ? v : 0;
+    return v;
+}
+
+static void sgemm_micro_scalar(int k, const float *a, const float *b, float *c, int ldc, const sgemm_store *s)
+{
+    float acc[4*8] = {0};
+    int p, i, j;
+    for(p = 0; p < k; ++p){
+        for(i = 0; i < 4; ++i){
+            float ai = a[p*4 + i];
+            for(j = 0; j < 8; ++j){
+                acc[i*8 + j] += ai*b[p*8 + j];
+            }
+        }
+    }
+    for(i = 0; i < 4; ++i){
+        for(j = 0; j < 8; ++j){
+            float *ct = c + i*ldc + j;
+            *ct = s ? sgemm_finish(acc[i*8 + j], ct, s, i) : *ct + acc[i*8 + j];
+        }
+    }
+}
+
+#ifdef SGEMM_X86
+
+__attribute__((target("avx2,fma")))
+static inline void sgemm_store_avx2(float *c, __m256 v, const sgemm_store *s, int i)
+{
+    if(s->load) v = _mm256_add_ps(v, _mm256_loadu_ps(c));
+    if(s->scales) v = _mm256_mul_ps(v, _mm256_set1_ps(s->scales[i]));
+    if(s->biases) v = _mm256_add_ps(v, _mm256_set1_ps(s->biases[i]));
+    if(s->activation == LEAKY) v = _mm256_max_ps(v, _mm256_mul_ps(v, _mm256_set1_ps(.1f)));
+    else if(s->activation == RELU) v = _mm256_max_ps(v, _mm256_setzero_ps());
+    _mm256_storeu_ps(c, v);
+}
+
+__attribute__((target("avx2,fma")))
+static void sgemm_micro_avx2(int k, const float *a, const float *b, float *c, int ldc, const sgemm_store *s)
+{
+    __m256 c00 = _mm256_setzero_ps(), c01 = _mm256_setzero_ps();
+    __m256 c10 = _mm256_setzero_ps(), c11 = _mm256_setzero_ps();
+    __m256 c20 = _mm256_setzero_ps(), c21 = _mm256_setzero_ps();
+    __m256 c30 = _mm256_setzero_ps(), c31 = _mm256_setzero_ps();
+    __m256 c40 = _mm256_setzero_ps(), c41 = _mm256_setzero_ps();
+    __m256 c50 = _mm256_setzero_ps(), c51 = _mm256_setzero_ps();
+    int p;
+    for(p = 0; p < k; ++p){
+        __m256 b0 = _mm256_load_ps(b);
+        __m256 b1 = _mm256_load_ps(b + 8);
+        __m256 ai;
+        ai = _mm256_broadcast_ss(a + 0); c00 = _mm256_fmadd_ps(ai, b0, c00); c01 = _mm256_fmadd_ps(ai, b1, c01);
+        ai = _mm256_broadcast_ss(a + 1); c10 = _mm256_fmadd_ps(ai, b0, c10); c11 = _mm256_fmadd_ps(ai, b1, c11);
+        ai = _mm256_broadcast_ss(a + 2); c20 = _mm256_fmadd_ps(ai, b0, c20); c21 = _mm256_fmadd_ps(ai, b1, c21);
+        ai = _mm256_broadcast_ss(a + 3); c30 = _mm256_fmadd_ps(ai, b0, c30); c31 = _mm256_fmadd_ps(ai, b1, c31);
+        ai = _mm256_broadcast_ss(a + 4); c40 = _mm256_fmadd_ps(ai, b0, c40); c41 = _mm256_fmadd_ps(ai, b1, c41);
+        ai = _mm256_broadcast_ss(a + 5); c50 = _mm256_fmadd_ps(ai, b0, c50); c51 = _mm256_fmadd_ps(ai, b1, c51);
+        a += 6;
+        b += 16;
+    }
+#define SGEMM_STORE_ROW(i, r0, r1) \
+    if(s){ \
+        sgemm_store_avx2(c + i*ldc,     r0, s, i); \
+        sgemm_store_avx2(c + i*ldc + 8, r1, s, i); \
+    } else { \
+        _mm256_storeu_ps(c + i*ldc,     _mm256_add_ps(_mm256_loadu_ps(c + i*ldc), r0)); \
+        _mm256_storeu_ps(c + i*ldc + 8, _mm256_add_ps(_mm256_loadu_ps(c + i*ldc + 8), r1)); \
+    }
+    SGEMM_STORE_ROW(0, c00, c01);
+    SGEMM_STORE_ROW(1, c10, c11);
+    SGEMM_STORE_ROW(2, c20, c21);
+    SGEMM_STORE_ROW(3, c30, c31);
+    SGEMM_STORE_ROW(4, c40, c41);
+    SGEMM_STORE_ROW(5, c50, c51);
+#undef SGEMM_STORE_ROW
+}
+
+__attribute__((target("avx512f")))
+static inline void sgemm_store_avx512(float *c, __m512 v, const sgemm_store *s, int i)
+{
+    if(s->load) v = _mm512_add_ps(v, _mm512_loadu_ps(c));
+    if(s->scales) v = _mm512_mul_ps(v, _mm512_set1_ps(s->scales[i]));
+    if(s->biases) v = _mm512_add_ps(v, _mm512_set1_ps(s->biases[i]));
+    if(s->activation == LEAKY) v = _mm512_max_ps(v, _mm512_mul_ps(v, _mm512_set1_ps(.1f)));
+    else if(s->activation == RELU) v = _mm512_max_ps(v, _mm512_setzero_ps());
+    _mm512_storeu_ps(c, v);
+}
+
+__attribute__((target("avx512f")))
+static void sgemm_micro_avx512(int k, const float *a, const float *b, float *c, int ldc, const sgemm_store *s)
+{
+    __m512 acc[8][2];
+    int p, i;
+    for(i = 0; i < 8; ++i){
+        acc[i][0] = _mm512_setzero_ps();
+        acc[i][1] = _mm512_setzero_ps();
+    }
+    for(p = 0; p < k; ++p){
+        __m512 b0 = _mm512_load_ps(b);
+        __m512 b1 = _mm512_load_ps(b + 16);
+        for(i = 0; i < 8; ++i){
+            __m512 ai = _mm512_set1_ps(a[i]);
+            acc[i][0] = _mm512_fmadd_ps(ai, b0, acc[i][0]);
+            acc[i][1] = _mm512_fmadd_ps(ai, b1, acc[i][1]);
+        }
+        a += 8;
+        b += 32;
+    }
+    for(i = 0; i < 8; ++i){
+        if(s){
+            sgemm_store_avx512(c + i*ldc,      acc[i][0], s, i);
+            sgemm_store_avx512(c + i*ldc + 16, acc[i][1], s, i);
+        } else {
+            _mm512_storeu_ps(c + i*ldc,      _mm512_add_ps(_mm512_loadu_ps(c + i*ldc), acc[i][0]));
+            _mm512_storeu_ps(c + i*ldc + 16, _mm512_add_ps(_mm512_loadu_ps(c + i*ldc + 16), acc[i][1]));
+        }
+    }
+}
+
+#endif
+
+/* MC x KC of A fits L2 next to a few B panels, KC x NR of B fits L1 */
+static const sgemm_kernel sgemm_scalar = {"scalar", 4, 8, 128, 256, 4096, sgemm_micro_scalar};
+#ifdef SGEMM_X86
+static const sgemm_kernel sgemm_avx2 = {"avx2", 6, 16, 144, 256, 4096, sgemm_micro_avx2};
+static const sgemm_kernel sgemm_avx512 = {"avx512", 8, 32, 144, 384, 4096, sgemm_micro_avx512};
+#endif
+
+static const sgemm_kernel *selected = 0;
+
+static const sgemm_kernel *sgemm_select()
+{
+    if(selected) return selected;
+    selected = &sgemm_scalar;
+#ifdef SGEMM_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx512f")) selected = &sgemm_avx512;
+    else if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) selected = &sgemm_avx2;
+#endif
+    return selected;
+}
+
+const char *sgemm_kernel_name()
+{
+    return sgemm_select()->name;
+}
+
+/* Pins the micro-kernel instead of taking the widest one the cpu has,
+ * returns 0 if it is unknown or not supported here */
+int sgemm_set_kernel(const char *name)
+{
+    if(0 == strcmp(name, "scalar")){
+        selected = &sgemm_scalar;
+        return 1;
+    }
+#ifdef SGEMM_X86
+    __builtin_cpu_init();
+    if(0 == strcmp(name, "avx2") && __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")){
+        selected = &sgemm_avx2;
+        return 1;
+    }
+    if(0 == strcmp(name, "avx512") && __builtin_cpu_supports("avx512f")){
+        selected = &sgemm_avx512;
+        return 1;
+    }
+#endif
+    return 0;
+}
+
+/* op(A)[i][p] = A[i*rs + p*cs] */
+static void pack_a(int mc, int kc, const float *A, int rs, int cs, float ALPHA, int mr, float *packed)
+{
+    int i, p, r;
+    for(i = 0; i < mc; i += mr){
+        int rows = (mc - i < mr) ? mc - i : mr;
+        for(p = 0; p < kc; ++p){
+            for(r = 0; r < rows; ++r) packed[r] = ALPHA*A[(i+r)*rs + p*cs];
+            for(; r < mr; ++r) packed[r] = 0;
+            packed += mr;
+        }
+    }
+}
+
+/* op(B) is either a strided matrix, op(B)[p][j] = B[p*rs + j*cs], or the
+ * im2col matrix of an image, which is then never materialized */
+typedef struct{
+    const float *B;
+    int rs, cs;
+    const float *im;
+    int channels, height, width;
+    int ksize, stride, pad;
+    int out_w, row0;
+} sgemm_b;
+
+static void pack_b_matrix(const sgemm_b *b, int pc, int kc, int jc, int nc, int nr, float *packed)
+{
+    int j, p, r;
+    const int rs = b->rs, cs = b->cs;
+    for(j = 0; j < nc; j += nr){
+        int cols = (nc - j < nr) ? nc - j : nr;
+        for(p = 0; p < kc; ++p){
+            const float *row = b->B + (pc + p)*rs + (jc + j)*cs;
+            if(cs == 1 && cols == nr){
+                memcpy(packed, row, nr*sizeof(float));
+            } else {
+                for(r = 0; r < cols; ++r) packed[r] = row[r*cs];
+                for(; r < nr; ++r) packed[r] = 0;
+            }
+            packed += nr;
+        }
+    }
+}
+
+/* Row p of the column matrix is channel p/(k*k) shifted by the kernel tap
+ * (p/k%k, p%k), column j is output pixel j of the rows from row0 on, same
+ * order as im2col_cpu */
+static void pack_b_image(const sgemm_b *b, int pc, int kc, int jc, int nc, int nr, float *packed)
+{
+    int ih0[SGEMM_MAX_NR], iw0[SGEMM_MAX_NR];
+    int j, p, r;
+    for(j = 0; j < nc; j += nr){
+        int cols = (nc - j < nr) ? nc - j : nr;
+        for(r = 0; r < cols; ++r){
+            int out = b->row0*b->out_w + jc + j + r;
+            ih0[r] = (out / b->out_w)*b->stride - b->pad;
+            iw0[r] = (out % b->out_w)*b->stride - b->pad;
+        }
+        for(p = 0; p < kc; ++p){
+            int row = pc + p;
+            int kw = row % b->ksize;
+            int kh = row / b->ksize % b->ksize;
+            const float *channel = b->im + (size_t)(row / b->ksize / b->ksize)*b->height*b->width;
+            for(r = 0; r < cols; ++r){
+                int ih = ih0[r] + kh;
+                int iw = iw0[r] + kw;
+                packed[r] = (ih < 0 || iw < 0 || ih >= b->height || iw >= b->width) ? 0 : channel[ih*b->width + iw];
+            }
+            for(; r < nr; ++r) packed[r] = 0;
+            packed += nr;
+        }
+    }
+}
+
+static void *sgemm_alloc(size_t n)
+{
+    void *p = 0;
+    if(posix_memalign(&p, 64, n*sizeof(float))){
+        fprintf(stderr, "sgemm: could not allocate %lu floats\n", (unsigned long)n);
+        exit(-1);
+    }
+    return p;
+}
+
+/* One KC x NC block of B and one MC x KC block of A, shared by the chunks
+ * parallel_for hands out, a chunk being a run of NR wide panels */
+typedef struct{
+    const sgemm_kernel *k;
+    void (*pack_b)(const sgemm_b *, int, int, int, int, int, float *);
+    const sgemm_b *b;
+    int pc, kb, jc, nb, ic, mb;
+    const float *block_a;
+    float *packed_b;
+    float *C;
+    int ldc;
+    const gemm_epilogue *ep;
+    int first, last;
+} sgemm_block;
+
+static void sgemm_pack_panels(void *arg, int begin, int end)
+{
+    sgemm_block *t = arg;
+    const int nr = t->k->nr;
+    int j = begin*nr;
+    int cols = (end*nr < t->nb) ? end*nr - j : t->nb - j;
+    t->pack_b(t->b, t->pc, t->kb, t->jc + j, cols, nr, t->packed_b + (size_t)j*t->kb);
+}
+
+static void sgemm_panels(void *arg, int begin, int end)
+{
+    sgemm_block *t = arg;
+    const sgemm_kernel *k = t->k;
+    const int mr = k->mr, nr = k->nr, kb = t->kb, ldc = t->ldc;
+    const gemm_epilogue *ep = t->ep;
+    float edge[SGEMM_MAX_TILE];
+    int jr, ir, r, c;
+    for(jr = begin*nr; jr < end*nr && jr < t->nb; jr += nr){
+        int cols = (t->nb - jr < nr) ? t->nb - jr : nr;
+        for(ir = 0; ir < t->mb; ir += mr){
+            int rows = (t->mb - ir < mr) ? t->mb - ir : mr;
+            float *ct = t->C + (t->ic + ir)*ldc + t->jc + jr;
+            const float *ap = t->block_a + ir*kb;
+            const float *bp = t->packed_b + jr*kb;
+            sgemm_store store = {!t->first, 0, 0, LINEAR};
+            if(ep && t->last){
+                store.scales = ep->scales ? ep->scales + t->ic + ir : 0;
+                store.biases = ep->biases ? ep->biases + t->ic + ir : 0;
+                store.activation = ep->activation;
+            }
+            const sgemm_store *s = (ep && (t->first || t->last)) ? &store : 0;
+            if(rows == mr && cols == nr){
+                k->kernel(kb, ap, bp, ct, ldc, s);
+            } else {
+                memset(edge, 0, mr*nr*sizeof(float));
+                k->kernel(kb, ap, bp, edge, nr, 0);
+                for(r = 0; r < rows; ++r){
+                    for(c = 0; c < cols; ++c){
+                        float *cr = ct + r*ldc + c;
+                        *cr = s ? sgemm_finish(edge[r*nr + c], cr, s, r) : *cr + edge[r*nr + c];
+                    }
+                }
+            }
+        }
+    }
+}
+
+/* With prepacked set, A was packed once by pack_gemm_a and op(A) is ignored,
+ * with ep set C is overwritten through the epilogue instead of added to.
+ * Packing B and the tiles of each block are split over the thread pool. */
+static void sgemm_blocked(int TA, int M, int N, int K, float ALPHA,
+        float *A, int lda,
+        const float *prepacked,
+        const sgemm_b *b,
+        float *C, int ldc,
+        const gemm_epilogue *ep)
+{
+    const sgemm_kernel *k = sgemm_select();
+    const int mr = k->mr, nr = k->nr;
+    if(M <= 0 || N <= 0 || K <= 0) return;
+
+    int ars = TA ? 1 : lda, acs = TA ? lda : 1;
+
+    int mc = M < k->mc ? M : k->mc;
+    int kc = K < k->kc ? K : k->kc;
+    int nc = N < k->nc ? N : k->nc;
+    const size_t padded_m = (size_t)(M + mr - 1)/mr*mr;
+    float *packed_a = prepacked ? 0 : sgemm_alloc((size_t)((mc + mr - 1)/mr*mr)*kc);
+    float *packed_b = sgemm_alloc((size_t)((nc + nr - 1)/nr*nr)*kc);
+
+    sgemm_block t = {0};
+    t.k = k;
+    t.pack_b = b->im ? pack_b_image : pack_b_matrix;
+    t.b = b;
+    t.packed_b = packed_b;
+    t.C = C;
+    t.ldc = ldc;
+    t.ep = ep;
+    for(t.jc = 0; t.jc < N; t.jc += k->nc){
+        t.nb = (N - t.jc < k->nc) ? N - t.jc : k->nc;
+        const int panels = (t.nb + nr - 1)/nr;
+        for(t.pc = 0; t.pc < K; t.pc += k->kc){
+            t.kb = (K - t.pc < k->kc) ? K - t.pc : k->kc;
+            t.first = t.pc == 0;
+            t.last = t.pc + t.kb >= K;
+            parallel_for(panels, 4, sgemm_pack_panels, &t);
+            for(t.ic = 0; t.ic < M; t.ic += k->mc){
+                t.mb = (M - t.ic < k->mc) ? M - t.ic : k->mc;
+                t.block_a = prepacked ? prepacked + t.pc*padded_m + (size_t)t.ic*t.kb : packed_a;
+                if(!prepacked) pack_a(t.mb, t.kb, A + t.ic*ars + t.pc*acs, ars, acs, ALPHA, mr, packed_a);
+                parallel_for(panels, 1, sgemm_panels, &t);
+            }
+        }
+    }
+    free(packed_a);
+    free(packed_b);
+}
+
+void gemm_packed(int TA, int TB, int M, int N, int K, float ALPHA,
+        float *A, int lda,
+        float *B, int ldb,
+        float *C, int ldc)
+{
+    sgemm_b b = {0};
+    b.B = B;
+    b.rs = TB ? 1 : ldb;
+    b.cs = TB ? ldb : 1;
+    sgemm_blocked(TA, M, N, K, ALPHA, A, lda, 0, &b, C, ldc, 0);
+}
+
+/* ALPHA * A (M x K) packed once, for the current kernel, in the order the
+ * blocked loops consume it: KC slices, each holding every MR tall panel.
+ * Returns the floats it takes, with packed 0 it only computes that. */
+size_t pack_gemm_a(int M, int K, float ALPHA, float *A, int lda, float *packed)
+{
+    const sgemm_kernel *k = sgemm_select();
+    const size_t padded_m = (size_t)(M + k->mr - 1)/k->mr*k->mr;
+    int pc;
+    for(pc = 0; packed && pc < K; pc += k->kc){
+        int kb = (K - pc < k->kc) ? K - pc : k->kc;
+        pack_a(M, kb, A + pc, lda, 1, ALPHA, k->mr, packed + pc*padded_m);
+    }
+    return padded_m*K;
+}
+
+/* C += A * B, or C = epilogue(A * B) when ep is set, with A from pack_gemm_a */
+void gemm_prepacked(int M, int N, int K,
+        const float *packed_a,
+        float *B, int ldb,
+        float *C, int ldc,
+        const gemm_epilogue *ep)
+{
+    sgemm_b b = {0};
+    b.B = B;
+    b.rs = ldb;
+    b.cs = 1;
+    sgemm_blocked(0, M, N, K, 1, 0, 0, packed_a, &b, C, ldc, ep);
+}
+
+void __attribute__ ((noinline)) gemm_nn_packed(int M, int N, int K, float ALPHA,
+        float *A, int lda,
+        float *B, int ldb,
+        float *C, int ldc)
+{
+    gemm_packed(0, 0, M, N, K, ALPHA, A, lda, B, ldb, C, ldc);
+}
+
+/* C = epilogue(A * B), nothing is read from C */
+void gemm_nn_fused(int M, int N, int K,
+        float *A, int lda,
+        float *B, int ldb,
+        float *C, int ldc,
+        const gemm_epilogue *ep)
+{
+    sgemm_b b = {0};
+    b.B = B;
+    b.rs = ldb;
+    b.cs = 1;
+    sgemm_blocked(0, M, N, K, 1, A, lda, 0, &b, C, ldc, ep);
+}
+
+static void conv_blocked(int M, float ALPHA,
+        float *A, int lda,
+        const float *prepacked,
+        float *im, int channels, int height, int width,
+        int ksize, int stride, int pad,
+        int row0, int rows,
+        float *C, int ldc,
+        const gemm_epilogue *ep)
+{
+    sgemm_b b = {0};
+    b.im = im;
+    b.channels = channels;
+    b.height = height;
+    b.width = width;
+    b.ksize = ksize;
+    b.stride = stride;
+    b.pad = pad;
+    b.out_w = (width + 2*pad - ksize)/stride + 1;
+    b.row0 = row0;
+    if(rows < 0) rows = (height + 2*pad - ksize)/stride + 1 - row0;
+    sgemm_blocked(0, M, rows*b.out_w, channels*ksize*ksize, ALPHA, A, lda, prepacked, &b, C, ldc, ep);
+}
+
+/* C (m x out_h*out_w) += ALPHA * A (m x channels*ksize*ksize) * im2col(im),
+ * with the column matrix packed panel by panel straight from the image, or
+ * C = epilogue(ALPHA * A * im2col(im)) when ep is set */
+void __attribute__ ((noinline)) conv_implicit(int M, float ALPHA,
+        float *A, int lda,
+        float *im, int channels, int height, int width,
+        int ksize, int stride, int pad,
+        float *C, int ldc,
+        const gemm_epilogue *ep)
+{
+    conv_blocked(M, ALPHA, A, lda, 0, im, channels, height, width, ksize, stride, pad, 0, -1, C, ldc, ep);
+}
+
+/* conv_implicit with A from pack_gemm_a */
+void conv_prepacked(int M,
+        const float *packed_a,
+        float *im, int channels, int height, int width,
+        int ksize, int stride, int pad,
+        float *C, int ldc,
+        const gemm_epilogue *ep)
+{
+    conv_blocked(M, 1, 0, 0, packed_a, im, channels, height, width, ksize, stride, pad, 0, -1, C, ldc, ep);
+}
+
+/* C = epilogue(A * im2col(im)) for the output rows [row0, row0 + rows) only,
+ * C then holds rows*out_w columns. A is packed_a from pack_gemm_a if that is
+ * set, else A with leading dimension lda */
+void conv_rows(int M,
+        float *A, int lda,
+        const float *packed_a,
+        float *im, int channels, int height, int width,
+        int ksize, int stride, int pad,
+        int row0, int rows,
+        float *C, int ldc,
+        const gemm_epilogue *ep)
+{
+    conv_blocked(M, 1, packed_a ? 0 : A, lda, packed_a, im, channels, height, width, ksize, stride, pad, row0, rows, C, ldc, ep);
+}
@@ -0,0 +1,385 @@
+#include "simd.h"
+#include "activations.h"
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SIMD_X86
+#include <immintrin.h>
+#endif
+
+/*
+ * Elementwise kernels over activation tensors.
+ *
+ * The workhorse is x = activation(scale*x + bias) over a contiguous run,
+ * which covers adding biases, scaling, batchnorm normalization with or
+ * without its scales and biases, and activating, alone or fused into one
+ * pass. The switch over activations is taken once per run, not once per
+ * element. Linear, relu, leaky and logistic have SSE and AVX2 loops, picked
+ * at runtime through cpuid like the sgemm kernels; logistic uses a
+ * polynomial exp good to a couple of ulp. The other activations, and the
+ * tails of the vector loops, run the scalar loop of their activation. The
+ * AVX2 loops clear the upper halves of the registers before handing their
+ * tails to code built without VEX, which would otherwise stall on every
+ * switch.
+ *
+ * The max pool kernels take the rows of windows that lie inside the input,
+ * any window size at stride 1 and 2x2 at stride 2, so they never check
+ * bounds.
+ */
+
+typedef struct{
+    const char *name;
+    void (*scale_bias_activate)(float *x, int n, float scale, float bias, ACTIVATION a);
+    void (*axpby)(int n, float a, const float *x, float b, float *y);
+    void (*fill)(float *x, int n, float v);
+    void (*max_window)(const float *in, int ldin, int size, int n, float *out);
+    void (*max_2x2s2)(const float *in, int ldin, int n, float *out);
+} simd_kernel;
+
+#define SIMD_LOOP(f) for(i = 0; i < n; ++i) x[i] = f(scale*x[i] + bias)
+
+static void scale_bias_activate_scalar(float *x, int n, float scale, float bias, ACTIVATION a)
+{
+    int i;
+    switch(a){
+        case LINEAR: SIMD_LOOP(linear_activate); break;
+        case LOGISTIC: SIMD_LOOP(logistic_activate); break;
+        case LOGGY: SIMD_LOOP(loggy_activate); break;
+        case RELU: SIMD_LOOP(relu_activate); break;
+        case ELU: SIMD_LOOP(elu_activate); break;
+        case SELU: SIMD_LOOP(selu_activate); break;
+        case RELIE: SIMD_LOOP(relie_activate); break;
+        case RAMP: SIMD_LOOP(ramp_activate); break;
+        case LEAKY: SIMD_LOOP(leaky_activate); break;
+        case TANH: SIMD_LOOP(tanh_activate); break;
+        case PLSE: SIMD_LOOP(plse_activate); break;
+        case STAIR: SIMD_LOOP(stair_activate); break;
+        case HARDTAN: SIMD_LOOP(hardtan_activate); break;
+        case LHTAN: SIMD_LOOP(lhtan_activate); break;
+    }
+}
+
+static void axpby_scalar(int n, float a, const float *x, float b, float *y)
+{
+    int i;
+    for(i = 0; i < n; ++i) y[i] = b*y[i] + a*x[i];
+}
+
+static void fill_scalar(float *x, int n, float v)
+{
+    int i;
+    for(i = 0; i < n; ++i) x[i] = v;
+}
+
+static void max_window_scalar(const float *in, int ldin, int size, int n, float *out)
+{
+    int j, r, m;
+    for(j = 0; j < n; ++j){
+        float max = in[j];
+        for(r = 0; r < size; ++r){
+            for(m = 0; m < size; ++m){
+                float v = in[r*ldin + j + m];
+                max = (v > max) ? v : max;
+            }
+        }
+        out[j] = max;
+    }
+}
+
+static void max_2x2s2_scalar(const float *in, int ldin, int n, float *out)
+{
+    int j;
+    for(j = 0; j < n; ++j){
+        float a = (in[2*j + 1] > in[2*j]) ? in[2*j + 1] : in[2*j];
+        float b = (in[ldin + 2*j + 1] > in[ldin + 2*j]) ? in[ldin + 2*j + 1] : in[ldin + 2*j];
+        out[j] = (b > a) ? b : a;
+    }
+}
+
+static int simd_activation(ACTIVATION a)
+{
+    return a == LINEAR || a == RELU || a == LEAKY || a == LOGISTIC;
+}
+
+#ifdef SIMD_X86
+
+/* exp as in Cephes: x = k ln2 + r, exp(r) from a degree 5 polynomial, the
+ * 2^k put straight into the exponent bits */
+#define SIMD_EXP_HI 88.3762626647949f
+#define SIMD_EXP_LO -88.3762626647949f
+#define SIMD_LOG2E 1.44269504088896341f
+#define SIMD_LN2_HI 0.693359375f
+#define SIMD_LN2_LO -2.12194440e-4f
+
+__attribute__((target("sse2")))
+static inline __m128 exp_sse(__m128 x)
+{
+    x = _mm_min_ps(_mm_max_ps(x, _mm_set1_ps(SIMD_EXP_LO)), _mm_set1_ps(SIMD_EXP_HI));
+    __m128 fx = _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(SIMD_LOG2E)), _mm_set1_ps(.5f));
+    __m128 k = _mm_cvtepi32_ps(_mm_cvttps_epi32(fx));
+    k = _mm_sub_ps(k, _mm_and_ps(_mm_cmpgt_ps(k, fx), _mm_set1_ps(1)));
+    x = _mm_sub_ps(x, _mm_mul_ps(k, _mm_set1_ps(SIMD_LN2_HI)));
+    x = _mm_sub_ps(x, _mm_mul_ps(k, _mm_set1_ps(SIMD_LN2_LO)));
+    __m128 y = _mm_set1_ps(1.9875691500E-4f);
+    y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(1.3981999507E-3f));
+    y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(8.3334519073E-3f));
+    y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(4.1665795894E-2f));
+    y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(1.6666665459E-1f));
+    y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(5.0000001201E-1f));
+    y = _mm_add_ps(_mm_add_ps(_mm_mul_ps(y, _mm_mul_ps(x, x)), x), _mm_set1_ps(1));
+    __m128i e = _mm_slli_epi32(_mm_add_epi32(_mm_cvttps_epi32(k), _mm_set1_epi32(127)), 23);
+    return _mm_mul_ps(y, _mm_castsi128_ps(e));
+}
+
+__attribute__((target("sse2")))
+static inline __m128 activate_sse(__m128 v, ACTIVATION a)
+{
+    if(a == RELU) return _mm_max_ps(v, _mm_setzero_ps());
+    if(a == LEAKY) return _mm_max_ps(v, _mm_mul_ps(v, _mm_set1_ps(.1f)));
+    if(a == LOGISTIC) return _mm_div_ps(_mm_set1_ps(1), _mm_add_ps(_mm_set1_ps(1), exp_sse(_mm_sub_ps(_mm_setzero_ps(), v))));
+    return v;
+}
+
+__attribute__((target("sse2")))
+static void scale_bias_activate_sse(float *x, int n, float scale, float bias, ACTIVATION a)
+{
+    if(!simd_activation(a)){
+        scale_bias_activate_scalar(x, n, scale, bias, a);
+        return;
+    }
+    const __m128 s = _mm_set1_ps(scale), b = _mm_set1_ps(bias);
+    int i = 0;
+    /* the switch is hoisted, activate_sse inlines into one loop per case */
+    switch(a){
+        case RELU: for(; i + 4 <= n; i += 4) _mm_storeu_ps(x + i, activate_sse(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(x + i), s), b), RELU)); break;
+        case LEAKY: for(; i + 4 <= n; i += 4) _mm_storeu_ps(x + i, activate_sse(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(x + i), s), b), LEAKY)); break;
+        case LOGISTIC: for(; i + 4 <= n; i += 4) _mm_storeu_ps(x + i, activate_sse(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(x + i), s), b), LOGISTIC)); break;
+        default: for(; i + 4 <= n; i += 4) _mm_storeu_ps(x + i, _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(x + i), s), b)); break;
+    }
+    scale_bias_activate_scalar(x + i, n - i, scale, bias, a);
+}
+
+__attribute__((target("sse2")))
+static void axpby_sse(int n, float a, const float *x, float b, float *y)
+{
+    const __m128 va = _mm_set1_ps(a), vb = _mm_set1_ps(b);
+    int i = 0;
+    for(; i + 4 <= n; i += 4){
+        _mm_storeu_ps(y + i, _mm_add_ps(_mm_mul_ps(vb, _mm_loadu_ps(y + i)), _mm_mul_ps(va, _mm_loadu_ps(x + i))));
+    }
+    axpby_scalar(n - i, a, x + i, b, y + i);
+}
+
+__attribute__((target("sse2")))
+static void fill_sse(float *x, int n, float v)
+{
+    const __m128 vv = _mm_set1_ps(v);
+    int i = 0;
+    for(; i + 4 <= n; i += 4) _mm_storeu_ps(x + i, vv);
+    fill_scalar(x + i, n - i, v);
+}
+
+__attribute__((target("sse2")))
+static void max_window_sse(const float *in, int ldin, int size, int n, float *out)
+{
+    int j = 0, r, m;
+    for(; j + 4 <= n; j += 4){
+        __m128 max = _mm_loadu_ps(in + j);
+        for(r = 0; r < size; ++r){
+            for(m = 0; m < size; ++m) max = _mm_max_ps(max, _mm_loadu_ps(in + r*ldin + j + m));
+        }
+        _mm_storeu_ps(out + j, max);
+    }
+    max_window_scalar(in + j, ldin, size, n - j, out + j);
+}
+
+__attribute__((target("sse2")))
+static void max_2x2s2_sse(const float *in, int ldin, int n, float *out)
+{
+    int j = 0;
+    for(; j + 4 <= n; j += 4){
+        __m128 a = _mm_max_ps(_mm_loadu_ps(in + 2*j), _mm_loadu_ps(in + ldin + 2*j));
+        __m128 b = _mm_max_ps(_mm_loadu_ps(in + 2*j + 4), _mm_loadu_ps(in + ldin + 2*j + 4));
+        _mm_storeu_ps(out + j, _mm_max_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2,0,2,0)), _mm_shuffle_ps(a, b, _MM_SHUFFLE(3,1,3,1))));
+    }
+    max_2x2s2_scalar(in + 2*j, ldin, n - j, out + j);
+}
+
+__attribute__((target("avx2,fma")))
+static inline __m256 exp_avx2(__m256 x)
+{
+    x = _mm256_min_ps(_mm256_max_ps(x, _mm256_set1_ps(SIMD_EXP_LO)), _mm256_set1_ps(SIMD_EXP_HI));
+    __m256 k = _mm256_floor_ps(_mm256_fmadd_ps(x, _mm256_set1_ps(SIMD_LOG2E), _mm256_set1_ps(.5f)));
+    x = _mm256_fnmadd_ps(k, _mm256_set1_ps(SIMD_LN2_HI), x);
+    x = _mm256_fnmadd_ps(k, _mm256_set1_ps(SIMD_LN2_LO), x);
+    __m256 y = _mm256_set1_ps(1.9875691500E-4f);
+    y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(1.3981999507E-3f));
+    y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(8.3334519073E-3f));
+    y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(4.1665795894E-2f));
+    y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(1.6666665459E-1f));
+    y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(5.0000001201E-1f));
+    y = _mm256_add_ps(_mm256_fmadd_ps(y, _mm256_mul_ps(x, x), x), _mm256_set1_ps(1));
+    __m256i e = _mm256_slli_epi32(_mm256_add_epi32(_mm256_cvttps_epi32(k), _mm256_set1_epi32(127)), 23);
+    return _mm256_mul_ps(y, _mm256_castsi256_ps(e));
+}
+
+__attribute__((target("avx2,fma")))
+static inline __m256 activate_avx2(__m256 v, ACTIVATION a)
+{
+    if(a == RELU) return _mm256_max_ps(v, _mm256_setzero_ps());
+    if(a == LEAKY) return _mm256_max_ps(v, _mm256_mul_ps(v, _mm256_set1_ps(.1f)));
+    if(a == LOGISTIC) return _mm256_div_ps(_mm256_set1_ps(1), _mm256_add_ps(_mm256_set1_ps(1), exp_avx2(_mm256_sub_ps(_mm256_setzero_ps(), v))));
+    return v;
+}
+
+__attribute__((target("avx2,fma")))
+static void scale_bias_activate_avx2(float *x, int n, float scale, float bias, ACTIVATION a)
+{
+    if(!simd_activation(a)){
+        scale_bias_activate_scalar(x, n, scale, bias, a);
+        return;
+    }
+    const __m256 s = _mm256_set1_ps(scale), b = _mm256_set1_ps(bias);
+    int i = 0;
+    switch(a){
+        case RELU: for(; i + 8 <= n; i += 8) _mm256_storeu_ps(x + i, activate_avx2(_mm256_fmadd_ps(_mm256_loadu_ps(x + i), s, b), RELU)); break;
+        case LEAKY: for(; i + 8 <= n; i += 8) _mm256_storeu_ps(x + i, activate_avx2(_mm256_fmadd_ps(_mm256_loadu_ps(x + i), s, b), LEAKY)); break;
+        case LOGISTIC: for(; i + 8 <= n; i += 8) _mm256_storeu_ps(x + i, activate_avx2(_mm256_fmadd_ps(_mm256_loadu_ps(x + i), s, b), LOGISTIC)); break;
+        default: for(; i + 8 <= n; i += 8) _mm256_storeu_ps(x + i, _mm256_fmadd_ps(_mm256_loadu_ps(x + i), s, b)); break;
+    }
+    _mm256_zeroupper();
+    scale_bias_activate_scalar(x + i, n - i, scale, bias, a);
+}
+
+__attribute__((target("avx2,fma")))
+static void axpby_avx2(int n, float a, const float *x, float b, float *y)
+{
+    const __m256 va = _mm256_set1_ps(a), vb = _mm256_set1_ps(b);
+    int i = 0;
+    for(; i + 8 <= n; i += 8){
+        _mm256_storeu_ps(y + i, _mm256_fmadd_ps(vb, _mm256_loadu_ps(y + i), _mm256_mul_ps(va, _mm256_loadu_ps(x + i))));
+    }
+    _mm256_zeroupper();
+    axpby_scalar(n - i, a, x + i, b, y + i);
+}
+
+__attribute__((target("avx2")))
+static void fill_avx2(float *x, int n, float v)
+{
+    const __m256 vv = _mm256_set1_ps(v);
+    int i = 0;
+    for(; i + 8 <= n; i += 8) _mm256_storeu_ps(x + i, vv);
+    _mm256_zeroupper();
+    fill_scalar(x + i, n - i, v);
+}
+
+__attribute__((target("avx2")))
+static void max_window_avx2(const float *in, int ldin, int size, int n, float *out)
+{
+    int j = 0, r, m;
+    for(; j + 8 <= n; j += 8){
+        __m256 max = _mm256_loadu_ps(in + j);
+        for(r = 0; r < size; ++r){
+            for(m = 0; m < size; ++m) max = _mm256_max_ps(max, _mm256_loadu_ps(in + r*ldin + j + m));
+        }
+        _mm256_storeu_ps(out + j, max);
+    }
+    _mm256_zeroupper();
+    max_window_sse(in + j, ldin, size, n - j, out + j);
+}
+
+/* even and odd columns split within each 128 bit lane, the permute puts the
+ * two lanes' halves back in order */
+__attribute__((target("avx2")))
+static void max_2x2s2_avx2(const float *in, int ldin, int n, float *out)
+{
+    int j = 0;
+    for(; j + 8 <= n; j += 8){
+        __m256 a = _mm256_max_ps(_mm256_loadu_ps(in + 2*j), _mm256_loadu_ps(in + ldin + 2*j));
+        __m256 b = _mm256_max_ps(_mm256_loadu_ps(in + 2*j + 8), _mm256_loadu_ps(in + ldin + 2*j + 8));
+        __m256 max = _mm256_max_ps(_mm256_shuffle_ps(a, b, _MM_SHUFFLE(2,0,2,0)), _mm256_shuffle_ps(a, b, _MM_SHUFFLE(3,1,3,1)));
+        _mm256_storeu_ps(out + j, _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(max), _MM_SHUFFLE(3,1,2,0))));
+    }
+    _mm256_zeroupper();
+    max_2x2s2_sse(in + 2*j, ldin, n - j, out + j);
+}
+
+#endif
+
+static const simd_kernel simd_scalar = {"scalar", scale_bias_activate_scalar, axpby_scalar, fill_scalar, max_window_scalar, max_2x2s2_scalar};
+#ifdef SIMD_X86
+static const simd_kernel simd_sse = {"sse", scale_bias_activate_sse, axpby_sse, fill_sse, max_window_sse, max_2x2s2_sse};
+static const simd_kernel simd_avx2 = {"avx2", scale_bias_activate_avx2, axpby_avx2, fill_avx2, max_window_avx2, max_2x2s2_avx2};
+#endif
+
+static const simd_kernel *selected = 0;
+
+static const simd_kernel *simd_select()
+{
+    if(selected) return selected;
+    selected = &simd_scalar;
+#ifdef SIMD_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) selected = &simd_avx2;
+    else if(__builtin_cpu_supports("sse2")) selected = &simd_sse;
+#endif
+    return selected;
+}
+
+const char *simd_kernel_name()
+{
+    return simd_select()->name;
+}
+
+/* Pins the kernels instead of taking the widest the cpu has, returns 0 if
+ * the name is unknown or not supported here */
+int simd_set_kernel(const char *name)
+{
+    if(0 == strcmp(name, "scalar")){
+        selected = &simd_scalar;
+        return 1;
+    }
+#ifdef SIMD_X86
+    __builtin_cpu_init();
+    if(0 == strcmp(name, "sse") && __builtin_cpu_supports("sse2")){
+        selected = &simd_sse;
+        return 1;
+    }
+    if(0 == strcmp(name, "avx2") && __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")){
+        selected = &simd_avx2;
+        return 1;
+    }
+#endif
+    return 0;
+}
+
+void simd_scale_bias_activate(float *x, int n, float scale, float bias, ACTIVATION a)
+{
+    if(a == LINEAR && scale == 1 && bias == 0) return;
+    simd_select()->scale_bias_activate(x, n, scale, bias, a);
+}
+
+void simd_activate(float *x, int n, ACTIVATION a)
+{
+    simd_scale_bias_activate(x, n, 1, 0, a);
+}
+
+void simd_axpby(int n, float a, const float *x, float b, float *y)
+{
+    simd_select()->axpby(n, a, x, b, y);
+}
+
+void simd_fill(float *x, int n, float v)
+{
+    simd_select()->fill(x, n, v);
+}
+
+void simd_max_window(const float *in, int ldin, int size, int n, float *out)
+{
+    simd_select()->max_window(in, ldin, size, n, out);
+}
+
+void simd_max_2x2s2(const float *in, int ldin, int n, float *out)
+{
+    simd_select()->max_2x2s2(in, ldin, n, out);
+}
@@ -0,0 +1,17 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+#include "darknet.h"
+
+/* x = a(scale*x + bias) over n contiguous floats */
+void simd_scale_bias_activate(float *x, int n, float scale, float bias, ACTIVATION a);
+void simd_activate(float *x, int n, ACTIVATION a);
+/* y = b*y + a*x */
+void simd_axpby(int n, float a, const float *x, float b, float *y);
+void simd_fill(float *x, int n, float v);
+/* out[j] = max of the size x size window at in + j, rows ldin apart */
+void simd_max_window(const float *in, int ldin, int size, int n, float *out);
+/* out[j] = max of the 2x2 window at in + 2*j */
+void simd_max_2x2s2(const float *in, int ldin, int n, float *out);
+
+#endif
@@ -0,0 +1,172 @@
+#define _GNU_SOURCE
+#include "threadpool.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/*
+ * Persistent thread pool with work stealing for the CPU forward pass.
+ *
+ * parallel_for splits [0, n) into chunks of grain iterations and hands every
+ * worker, the calling thread included, a contiguous run of them in its own
+ * deque. A worker takes chunks from the front of its deque, so it walks its
+ * share in order. Once that is empty it steals from the back of the others,
+ * away from where their owners are working. The workers sleep between loops,
+ * after spinning briefly so back to back loops of one layer do not pay a
+ * wake up each. A parallel_for inside a chunk runs serially in that thread.
+ *
+ * pool_threads is 1 by default, which keeps every loop serial and the access
+ * patterns the simulations trace unchanged; -threads sets it. With
+ * pool_affinity set, worker i is pinned to cpu i.
+ */
+
+int pool_threads = 1;
+int pool_affinity = 0;
+
+#define POOL_SPIN 20000
+
+typedef struct{
+    pthread_mutex_t lock;
+    int head, tail;
+} pool_deque;
+
+typedef struct{
+    parallel_fn fn;
+    void *arg;
+    int n, grain;
+} pool_job;
+
+static struct{
+    int size;
+    pool_deque *deques;
+    pthread_mutex_t lock;
+    pthread_cond_t start, done;
+    pool_job job;
+    volatile unsigned generation;
+    int active;
+    int finished;
+} pool;
+
+static __thread int pool_worker = -1;
+
+static void pool_pin(int w)
+{
+#ifdef __linux__
+    if(!pool_affinity) return;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(w % sysconf(_SC_NPROCESSORS_ONLN), &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#endif
+}
+
+/* The next chunk for worker w, its own first, then one stolen */
+static int pool_next(int w, int *chunk)
+{
+    int i;
+    for(i = 0; i < pool.size; ++i){
+        pool_deque *d = &pool.deques[(w + i) % pool.size];
+        int found = 0;
+        pthread_mutex_lock(&d->lock);
+        if(d->head < d->tail){
+            *chunk = i ? --d->tail : d->head++;
+            found = 1;
+        }
+        pthread_mutex_unlock(&d->lock);
+        if(found) return 1;
+    }
+    return 0;
+}
+
+static void pool_work(int w, pool_job job)
+{
+    int chunk;
+    while(pool_next(w, &chunk)){
+        int begin = chunk*job.grain;
+        int end = (begin + job.grain < job.n) ? begin + job.grain : job.n;
+        job.fn(job.arg, begin, end);
+        __atomic_add_fetch(&pool.finished, 1, __ATOMIC_ACQ_REL);
+    }
+}
+
+static void *pool_thread(void *ptr)
+{
+    int w = (int)(size_t)ptr;
+    unsigned seen = 0;
+    pool_worker = w;
+    pool_pin(w);
+    while(1){
+        int spin;
+        for(spin = 0; spin < POOL_SPIN && pool.generation == seen; ++spin) sched_yield();
+        pthread_mutex_lock(&pool.lock);
+        while(pool.generation == seen) pthread_cond_wait(&pool.start, &pool.lock);
+        seen = pool.generation;
+        pool_job job = pool.job;
+        ++pool.active;
+        pthread_mutex_unlock(&pool.lock);
+
+        pool_work(w, job);
+
+        pthread_mutex_lock(&pool.lock);
+        --pool.active;
+        pthread_cond_broadcast(&pool.done);
+        pthread_mutex_unlock(&pool.lock);
+    }
+    return 0;
+}
+
+static void pool_start(int size)
+{
+    int i;
+    pool.size = size;
+    pool.deques = calloc(size, sizeof(pool_deque));
+    for(i = 0; i < size; ++i) pthread_mutex_init(&pool.deques[i].lock, 0);
+    pthread_mutex_init(&pool.lock, 0);
+    pthread_cond_init(&pool.start, 0);
+    pthread_cond_init(&pool.done, 0);
+    pool_pin(0);
+    for(i = 1; i < size; ++i){
+        pthread_t thread;
+        if(pthread_create(&thread, 0, pool_thread, (void *)(size_t)i)){
+            fprintf(stderr, "Could not start thread pool worker %d\n", i);
+            exit(-1);
+        }
+        pthread_detach(thread);
+    }
+}
+
+void parallel_for(int n, int grain, parallel_fn fn, void *arg)
+{
+    if(grain < 1) grain = 1;
+    if(pool_threads <= 1 || pool_worker >= 0 || n <= grain){
+        if(n > 0) fn(arg, 0, n);
+        return;
+    }
+    if(!pool.size) pool_start(pool_threads);
+
+    int i;
+    int chunks = (n + grain - 1)/grain;
+    pool_job job = {fn, arg, n, grain};
+    pthread_mutex_lock(&pool.lock);
+    /* stragglers of the last loop may still be scanning the deques */
+    while(pool.active) pthread_cond_wait(&pool.done, &pool.lock);
+    for(i = 0; i < pool.size; ++i){
+        pool.deques[i].head = (int)((long)chunks*i/pool.size);
+        pool.deques[i].tail = (int)((long)chunks*(i + 1)/pool.size);
+    }
+    pool.job = job;
+    pool.finished = 0;
+    ++pool.generation;
+    pthread_cond_broadcast(&pool.start);
+    pthread_mutex_unlock(&pool.lock);
+
+    pool_worker = 0;
+    pool_work(0, job);
+    pool_worker = -1;
+
+    pthread_mutex_lock(&pool.lock);
+    while(__atomic_load_n(&pool.finished, __ATOMIC_ACQUIRE) < chunks) pthread_cond_wait(&pool.done, &pool.lock);
+    pthread_mutex_unlock(&pool.lock);
+}
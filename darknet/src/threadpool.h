@@ -0,0 +1,19 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include "darknet.h"
+
+/* Runs fn(arg, begin, end) over chunks of [0, n) at most grain long */
+typedef void (*parallel_fn)(void *arg, int begin, int end);
+void parallel_for(int n, int grain, parallel_fn fn, void *arg);
+
+/* Elements an elementwise chunk should cover at least */
+#define PARALLEL_GRAIN 16384
+
+/* Grain for loops over channels of size elements */
+static inline int parallel_channels(int size)
+{
+    return (size >= PARALLEL_GRAIN || size < 1) ? 1 : PARALLEL_GRAIN/size;
+}
+
+#endif
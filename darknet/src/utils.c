@@ -724,3 +724,18 @@ float **one_hot_encode(float *a, int n, int k)
     return t;
 }
 
+
+/*
+ * The simulator finds these by name and switches between fast-forward, warming
+ * and detailed simulation when they are called. The empty asm keeps the calls
+ * from being optimized away.
+ */
+void __attribute__((noinline)) sim_roi_begin(const char *tag)
+{
+    __asm__ volatile("" : : "r"(tag) : "memory");
+}
+
+void __attribute__((noinline)) sim_roi_end()
+{
+    __asm__ volatile("" : : : "memory");
+}
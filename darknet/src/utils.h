@@ -49,5 +49,9 @@ float sec(clock_t clocks);
 void print_statistics(float *a, int n);
 int int_index(int *a, int val, int n);
 
+/* Region of interest markers for the pin cache simulator, no-ops when run natively */
+void sim_roi_begin(const char *tag);
+void sim_roi_end();
+
 #endif
 
@@ -0,0 +1,375 @@
+#include "winograd.h"
+#include "gemm.h"
+#include "threadpool.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+/*
+ * Winograd F(m x m, 3 x 3) convolution for stride 1, ungrouped 3x3 layers.
+ *
+ * Every t x t input tile d (t = m + 2, tiles overlap by 2) is transformed to
+ * V = B^T d B and every 3x3 filter g to U = G g G^T, once at load time. For
+ * each of the t*t tile positions xi the products over channels are one GEMM,
+ * M_xi (n x tiles) = U_xi (n x c) * V_xi (c x tiles), and each output tile is
+ * Y = A^T M A. F(4x4) does 36 multiplies per 16 outputs instead of 144,
+ * F(2x2) 16 per 4 instead of 36. Tiles are processed in blocks so V and M
+ * stay near L2 size instead of growing with the image.
+ */
+
+int winograd_conv = 1;
+
+#define WINOGRAD_MAX_T 6
+#define WINOGRAD_BLOCK_BYTES (2*1024*1024)
+#define WINOGRAD_MIN_BLOCK 64
+#define WINOGRAD_TOLERANCE 1e-4
+#define WINOGRAD_MIN_CHANNELS 8
+
+static const float G2[4*3] = {
+    1,     0,    0,
+    .5f,  .5f,  .5f,
+    .5f, -.5f,  .5f,
+    0,     0,    1
+};
+
+static const float G4[6*3] = {
+     1/4.f,      0,       0,
+    -1/6.f,  -1/6.f,  -1/6.f,
+    -1/6.f,   1/6.f,  -1/6.f,
+     1/24.f,  1/12.f,  1/6.f,
+     1/24.f, -1/12.f,  1/6.f,
+     0,          0,       1
+};
+
+/* One dimensional B^T and A^T over n tiles at once: element i of tile k is
+ * x[i*xs + k], its transform goes to y[i*ys + k] */
+static void bt2(const float *x, size_t xs, float *y, size_t ys, int n)
+{
+    int k;
+    for(k = 0; k < n; ++k){
+        float x0 = x[k], x1 = x[xs + k], x2 = x[2*xs + k], x3 = x[3*xs + k];
+        y[k]        = x0 - x2;
+        y[ys + k]   = x1 + x2;
+        y[2*ys + k] = x2 - x1;
+        y[3*ys + k] = x1 - x3;
+    }
+}
+
+static void at2(const float *x, size_t xs, float *y, size_t ys, int n)
+{
+    int k;
+    for(k = 0; k < n; ++k){
+        float x0 = x[k], x1 = x[xs + k], x2 = x[2*xs + k], x3 = x[3*xs + k];
+        y[k]      = x0 + x1 + x2;
+        y[ys + k] = x1 - x2 - x3;
+    }
+}
+
+static void bt4(const float *x, size_t xs, float *y, size_t ys, int n)
+{
+    int k;
+    for(k = 0; k < n; ++k){
+        float x0 = x[k], x1 = x[xs + k], x2 = x[2*xs + k];
+        float x3 = x[3*xs + k], x4 = x[4*xs + k], x5 = x[5*xs + k];
+        y[k]        = 4*x0 - 5*x2 + x4;
+        y[ys + k]   = -4*(x1 + x2) + x3 + x4;
+        y[2*ys + k] = 4*(x1 - x2) - x3 + x4;
+        y[3*ys + k] = 2*(x3 - x1) - x2 + x4;
+        y[4*ys + k] = 2*(x1 - x3) - x2 + x4;
+        y[5*ys + k] = 4*x1 - 5*x3 + x5;
+    }
+}
+
+static void at4(const float *x, size_t xs, float *y, size_t ys, int n)
+{
+    int k;
+    for(k = 0; k < n; ++k){
+        float x0 = x[k], x1 = x[xs + k], x2 = x[2*xs + k];
+        float x3 = x[3*xs + k], x4 = x[4*xs + k], x5 = x[5*xs + k];
+        float a = x1 + x2, b = x1 - x2, c = x3 + x4, d = x3 - x4;
+        y[k]        = x0 + a + c;
+        y[ys + k]   = b + 2*d;
+        y[2*ys + k] = a + 4*c;
+        y[3*ys + k] = b + 8*d + x5;
+    }
+}
+
+typedef void (*winograd_1d)(const float *x, size_t xs, float *y, size_t ys, int n);
+
+typedef struct{
+    int m, t;
+    const float *G;
+    winograd_1d bt, at;
+} winograd_tile;
+
+static winograd_tile get_winograd_tile(int m)
+{
+    winograd_tile w;
+    w.m = m;
+    w.t = m + 2;
+    w.G  = (m == 4) ? G4  : G2;
+    w.bt = (m == 4) ? bt4 : bt2;
+    w.at = (m == 4) ? at4 : at2;
+    return w;
+}
+
+/* U = G g G^T of every filter, one n x c matrix per tile position xi, each
+ * packed for gemm_prepacked and size floats apart */
+static float *transform_weights(layer l, winograd_tile w, size_t *size)
+{
+    const int t = w.t, tt = t*t;
+    float *U = calloc((size_t)tt*l.n*l.c, sizeof(float));
+    float tmp[WINOGRAD_MAX_T*3];
+    int i, j, xi, r, q, k;
+    for(i = 0; i < l.n; ++i){
+        for(j = 0; j < l.c; ++j){
+            const float *g = l.weights + (i*l.c + j)*9;
+            for(r = 0; r < t; ++r){
+                for(q = 0; q < 3; ++q){
+                    float sum = 0;
+                    for(k = 0; k < 3; ++k) sum += w.G[r*3 + k]*g[k*3 + q];
+                    tmp[r*3 + q] = sum;
+                }
+            }
+            for(r = 0; r < t; ++r){
+                for(q = 0; q < t; ++q){
+                    float sum = 0;
+                    for(k = 0; k < 3; ++k) sum += tmp[r*3 + k]*w.G[q*3 + k];
+                    U[((size_t)(r*t + q)*l.n + i)*l.c + j] = sum;
+                }
+            }
+        }
+    }
+    *size = pack_gemm_a(l.n, l.c, 1, 0, l.c, 0);
+    float *packed = calloc(*size*tt, sizeof(float));
+    for(xi = 0; xi < tt; ++xi){
+        pack_gemm_a(l.n, l.c, 1, U + (size_t)xi*l.n*l.c, l.c, packed + xi**size);
+    }
+    free(U);
+    return packed;
+}
+
+/* The epilogue of output channel c over n outputs */
+static void finish_tiles(float *y, int n, const gemm_epilogue *ep, int c)
+{
+    const float scale = ep->scales ? ep->scales[c] : 1;
+    const float bias = ep->biases ? ep->biases[c] : 0;
+    int i;
+    for(i = 0; i < n; ++i){
+        float v = y[i]*scale + bias;
+        if(ep->activation == LEAKY) v = (v > 0) ? v : .1f*v;
+        else if(ep->activation == RELU) v = (v > 0) ? v : 0;
+        y[i] = v;
+    }
+}
+
+/* One block of tiles, shared by the chunks parallel_for hands out. V holds
+ * t*t matrices of c x tiles, M t*t matrices of n x tiles. */
+typedef struct{
+    layer l;
+    winograd_tile w;
+    const float *U;
+    size_t size;
+    float *input, *output;
+    const gemm_epilogue *ep;
+    int p0, nb, block, tiles_w;
+    float *V, *M;
+    size_t vs, ms;
+} winograd_block;
+
+/* Input tiles of channels [c0, c1), D and T hold one channel's tiles element
+ * by element while they are transformed */
+static void winograd_inputs(void *arg, int c0, int c1)
+{
+    winograd_block *b = arg;
+    const layer l = b->l;
+    const int m = b->w.m, t = b->w.t, tt = t*t, block = b->block;
+    float *D = malloc((size_t)tt*block*sizeof(float));
+    float *T = malloc((size_t)tt*block*sizeof(float));
+    int c, p, i, j;
+    for(c = c0; c < c1; ++c){
+        const float *im = b->input + (size_t)c*l.h*l.w;
+        for(p = 0; p < b->nb; ++p){
+            int row = (b->p0 + p)/b->tiles_w*m - l.pad;
+            int col = (b->p0 + p)%b->tiles_w*m - l.pad;
+            int inside = row >= 0 && col >= 0 && row + t <= l.h && col + t <= l.w;
+            for(i = 0; i < t; ++i){
+                for(j = 0; j < t; ++j){
+                    int r = row + i, q = col + j;
+                    D[(i*t + j)*block + p] = (inside || (r >= 0 && q >= 0 && r < l.h && q < l.w)) ? im[r*l.w + q] : 0;
+                }
+            }
+        }
+        for(j = 0; j < t; ++j) b->w.bt(D + j*block, t*block, T + j*block, t*block, b->nb);
+        for(i = 0; i < t; ++i) b->w.bt(T + i*t*block, block, b->V + (size_t)i*t*b->vs + c*block, b->vs, b->nb);
+    }
+    free(D);
+    free(T);
+}
+
+/* The GEMMs of tile positions [x0, x1) */
+static void winograd_products(void *arg, int x0, int x1)
+{
+    winograd_block *b = arg;
+    const layer l = b->l;
+    int i;
+    for(i = x0; i < x1; ++i){
+        memset(b->M + i*b->ms, 0, b->ms*sizeof(float));
+        gemm_prepacked(l.n, b->nb, l.c, b->U + i*b->size, b->V + i*b->vs, b->block, b->M + i*b->ms, b->block, 0);
+    }
+}
+
+/* Output tiles of filters [c0, c1), with ep set each output is finished as
+ * the GEMM epilogue would */
+static void winograd_outputs(void *arg, int c0, int c1)
+{
+    winograd_block *b = arg;
+    const layer l = b->l;
+    const int m = b->w.m, t = b->w.t, tt = t*t, block = b->block;
+    float *D = malloc((size_t)tt*block*sizeof(float));
+    float *T = malloc((size_t)tt*block*sizeof(float));
+    int c, p, i, j;
+    for(c = c0; c < c1; ++c){
+        float *out = b->output + (size_t)c*l.out_h*l.out_w;
+        for(j = 0; j < t; ++j) b->w.at(b->M + j*b->ms + c*block, t*b->ms, T + j*block, t*block, b->nb);
+        for(i = 0; i < m; ++i) b->w.at(T + i*t*block, block, D + i*m*block, block, b->nb);
+        for(i = 0; b->ep && i < m*m; ++i) finish_tiles(D + i*block, b->nb, b->ep, c);
+        for(p = 0; p < b->nb; ++p){
+            int row = (b->p0 + p)/b->tiles_w*m;
+            int col = (b->p0 + p)%b->tiles_w*m;
+            for(i = 0; i < m && row + i < l.out_h; ++i){
+                for(j = 0; j < m && col + j < l.out_w; ++j){
+                    out[(row + i)*l.out_w + col + j] = D[(i*m + j)*block + p];
+                }
+            }
+        }
+    }
+    free(D);
+    free(T);
+}
+
+/* Each block is transformed over channels, multiplied over tile positions
+ * and transformed back over filters, every step split over the thread pool */
+static void winograd_convolve(layer l, winograd_tile w, const float *U, size_t size, float *input, float *output, const gemm_epilogue *ep)
+{
+    const int m = w.m, t = w.t, tt = t*t;
+    const int tiles_h = (l.out_h + m - 1)/m;
+    const int tiles_w = (l.out_w + m - 1)/m;
+    const int tiles = tiles_h*tiles_w;
+
+    int block = WINOGRAD_BLOCK_BYTES/(tt*(l.c + l.n)*sizeof(float));
+    if(block < WINOGRAD_MIN_BLOCK) block = WINOGRAD_MIN_BLOCK;
+    if(block > tiles) block = tiles;
+
+    winograd_block b = {0};
+    b.l = l;
+    b.w = w;
+    b.U = U;
+    b.size = size;
+    b.input = input;
+    b.output = output;
+    b.ep = ep;
+    b.block = block;
+    b.tiles_w = tiles_w;
+    b.V = malloc((size_t)tt*l.c*block*sizeof(float));
+    b.M = malloc((size_t)tt*l.n*block*sizeof(float));
+    b.vs = (size_t)l.c*block;
+    b.ms = (size_t)l.n*block;
+
+    for(b.p0 = 0; b.p0 < tiles; b.p0 += block){
+        b.nb = (tiles - b.p0 < block) ? tiles - b.p0 : block;
+        parallel_for(l.c, 4, winograd_inputs, &b);
+        parallel_for(tt, 1, winograd_products, &b);
+        parallel_for(l.n, 4, winograd_outputs, &b);
+    }
+    free(b.V);
+    free(b.M);
+}
+
+/* Largest error of F(m x m) against a direct convolution on a small random
+ * input with the layer's channels, weights and padding, relative to the
+ * largest output. It has its own generator so loading weights leaves the
+ * rand() sequence alone. */
+float winograd_error(layer l, int m)
+{
+    unsigned int seed = 12345;
+    winograd_tile w = get_winograd_tile(m);
+    layer s = l;
+    s.h = s.w = 2*m + 3;
+    s.out_h = s.h + 2*s.pad - 2;
+    s.out_w = s.w + 2*s.pad - 2;
+
+    float *input = calloc((size_t)s.c*s.h*s.w, sizeof(float));
+    float *fast = calloc((size_t)s.n*s.out_h*s.out_w, sizeof(float));
+    size_t size;
+    float *U = transform_weights(s, w, &size);
+    int i, c, y, x, ky, kx;
+    for(i = 0; i < s.c*s.h*s.w; ++i){
+        seed = seed*1103515245 + 12345;
+        input[i] = (seed >> 8)/(float)(1 << 24)*2 - 1;
+    }
+    winograd_convolve(s, w, U, size, input, fast, 0);
+
+    float worst = 0, largest = 0;
+    for(i = 0; i < s.n; ++i){
+        for(y = 0; y < s.out_h; ++y){
+            for(x = 0; x < s.out_w; ++x){
+                double sum = 0;
+                for(c = 0; c < s.c; ++c){
+                    for(ky = 0; ky < 3; ++ky){
+                        for(kx = 0; kx < 3; ++kx){
+                            int r = y + ky - s.pad, q = x + kx - s.pad;
+                            if(r < 0 || q < 0 || r >= s.h || q >= s.w) continue;
+                            sum += s.weights[((i*s.c + c)*3 + ky)*3 + kx]*input[(c*s.h + r)*s.w + q];
+                        }
+                    }
+                }
+                float diff = fabs(sum - fast[(i*s.out_h + y)*s.out_w + x]);
+                if(diff > worst) worst = diff;
+                if(fabs(sum) > largest) largest = fabs(sum);
+            }
+        }
+    }
+    free(input);
+    free(fast);
+    free(U);
+    return largest > 0 ? worst/largest : worst;
+}
+
+/* Picks F(4x4) when the image is large enough that few tile outputs fall off
+ * the edge and it passes the accuracy check, then F(2x2), otherwise leaves the
+ * layer on the direct path. With few input channels the transforms cost more
+ * than the multiplies they save, so those layers stay direct too. Nothing is
+ * checked or transformed when -nowinograd or -gemm naive rule Winograd out,
+ * so those runs load exactly as before. */
+void prepare_winograd_layer(layer *l)
+{
+    free(l->winograd_weights);
+    l->winograd_weights = 0;
+    l->winograd = 0;
+    if(!winograd_conv || gemm_kernel != GEMM_PACKED) return;
+    if(l->type != CONVOLUTIONAL || l->size != 3 || l->stride != 1 || l->groups != 1) return;
+    if(l->xnor || l->binary || l->c < WINOGRAD_MIN_CHANNELS) return;
+
+    int m;
+    for(m = 4; m >= 2; m -= 2){
+        if(m == 4 && (l->out_h < 16 || l->out_w < 16)) continue;
+        if(winograd_error(*l, m) > WINOGRAD_TOLERANCE) continue;
+        l->winograd = m;
+        size_t size;
+        l->winograd_weights = transform_weights(*l, get_winograd_tile(m), &size);
+        return;
+    }
+}
+
+int use_winograd(layer l, network net)
+{
+    return winograd_conv && l.winograd && !net.train && gemm_kernel == GEMM_PACKED;
+}
+
+void forward_winograd(layer l, float *input, float *output, const gemm_epilogue *ep)
+{
+    size_t size = pack_gemm_a(l.n, l.c, 1, 0, l.c, 0);
+    winograd_convolve(l, get_winograd_tile(l.winograd), l.winograd_weights, size, input, output, ep);
+}
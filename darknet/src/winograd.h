@@ -0,0 +1,12 @@
+#ifndef WINOGRAD_H
+#define WINOGRAD_H
+
+#include "darknet.h"
+#include "gemm.h"
+
+void prepare_winograd_layer(layer *l);
+int use_winograd(layer l, network net);
+void forward_winograd(layer l, float *input, float *output, const gemm_epilogue *ep);
+float winograd_error(layer l, int m);
+
+#endif
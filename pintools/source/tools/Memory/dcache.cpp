@@ -21,20 +21,34 @@
 #include <fstream>
 #include <cassert>
 #include <string>
+#include <sstream>
+#include <vector>
+#include <algorithm>
 
 #include "cache.H"
+#include "scratchpad.H"
+#include "tlb.H"
+#include "timing.H"
+#include "dram.H"
+#include "compcache.H"
+#include "sectorcache.H"
+#include "partcache.H"
+#include "incache.H"
+#include "reuse.H"
 #include "pin_profile.H"
 using std::cerr;
 using std::endl;
 
 #define USE_L2_CACHE
 // #define ECOLCACHE
+// #define ESKEWCACHE
 #define PREFETCH_SIZE 64
 
-UINT32 Load_Hits;
-UINT32 Load_Misses;
-UINT32 Store_Hits;
-UINT32 Store_Misses;
+// the DRAM model is fed by the fill and eviction log of the last level,
+// which only the CACHE template keeps
+#if defined(USE_L2_CACHE) || (!defined(ECOLCACHE) && !defined(ESKEWCACHE))
+#define USE_DRAM_MODEL
+#endif
 
 /* ===================================================================== */
 /* Commandline Switches */
@@ -59,6 +73,162 @@ KNOB<UINT32> Knobl2Associativity(KNOB_MODE_WRITEONCE, "pintool",
     "l2a","4", "cache associativity (1 for direct mapped)");
 #endif    
 
+#ifdef ECOLCACHE
+KNOB<UINT32> Knobl1RehashMask(KNOB_MODE_WRITEONCE, "pintool",
+    "l1rehash","0", "column associative rehash: alternate set = set ^ mask (0 flips the set index MSB)");
+#endif
+
+#if !defined(ECOLCACHE) && !defined(ESKEWCACHE)
+KNOB<UINT32> Knobl1BufferEntries(KNOB_MODE_WRITEONCE, "pintool",
+    "l1vc","0", "entries of a fully associative buffer next to L1 (0 for none)");
+KNOB<string> Knobl1BufferKind(KNOB_MODE_WRITEONCE, "pintool",
+    "l1vck","victim", "L1 buffer kind: victim (swap on hit) or miss (Jouppi miss cache)");
+#endif
+#ifdef USE_L2_CACHE
+KNOB<UINT32> Knobl2BufferEntries(KNOB_MODE_WRITEONCE, "pintool",
+    "l2vc","0", "entries of a fully associative buffer next to L2 (0 for none)");
+KNOB<string> Knobl2BufferKind(KNOB_MODE_WRITEONCE, "pintool",
+    "l2vck","victim", "L2 buffer kind: victim (swap on hit) or miss (Jouppi miss cache)");
+#endif
+
+KNOB<FLT32> KnobSpmSize(KNOB_MODE_WRITEONCE, "pintool",
+    "spm","0", "scratchpad size in kilobytes (0 for none)");
+KNOB<UINT32> KnobSpmTileM(KNOB_MODE_WRITEONCE, "pintool",
+    "spmtm","32", "scratchpad tile rows of A and C (gemm M)");
+KNOB<UINT32> KnobSpmTileN(KNOB_MODE_WRITEONCE, "pintool",
+    "spmtn","32", "scratchpad tile columns of B and C (gemm N)");
+KNOB<UINT32> KnobSpmTileK(KNOB_MODE_WRITEONCE, "pintool",
+    "spmtk","32", "scratchpad tile depth of A and B (gemm K)");
+KNOB<BOOL> KnobSpmDoubleBuffer(KNOB_MODE_WRITEONCE, "pintool",
+    "spmdb","1", "reserve a transfer buffer per scratchpad region");
+
+KNOB<UINT32> KnobTlbPage(KNOB_MODE_WRITEONCE, "pintool",
+    "tlbpage","4", "TLB page size in kilobytes, 4 or 2048");
+KNOB<UINT32> KnobDtlbEntries(KNOB_MODE_WRITEONCE, "pintool",
+    "dtlbe","0", "DTLB entries (0 for no TLB model)");
+KNOB<UINT32> KnobDtlbAssociativity(KNOB_MODE_WRITEONCE, "pintool",
+    "dtlba","4", "DTLB associativity");
+KNOB<UINT32> KnobStlbEntries(KNOB_MODE_WRITEONCE, "pintool",
+    "stlbe","0", "second level STLB entries (0 for none)");
+KNOB<UINT32> KnobStlbAssociativity(KNOB_MODE_WRITEONCE, "pintool",
+    "stlba","8", "STLB associativity");
+KNOB<UINT32> KnobWalkBytes(KNOB_MODE_WRITEONCE, "pintool",
+    "walkb","64", "bytes fetched per page table reference of a page walk");
+
+KNOB<BOOL> KnobTiming(KNOB_MODE_WRITEONCE, "pintool",
+    "tm","0", "estimate cycles with a non-blocking timing model");
+KNOB<UINT32> KnobTimingL1Latency(KNOB_MODE_WRITEONCE, "pintool",
+    "tml1","4", "L1 hit latency in cycles, misses pay it before the next level");
+KNOB<UINT32> KnobTimingL2Latency(KNOB_MODE_WRITEONCE, "pintool",
+    "tml2","12", "L2 hit latency in cycles");
+KNOB<UINT32> KnobTimingMemoryLatency(KNOB_MODE_WRITEONCE, "pintool",
+    "tmmem","200", "memory latency in cycles");
+KNOB<UINT32> KnobTimingMshrs(KNOB_MODE_WRITEONCE, "pintool",
+    "mshr","8", "miss status holding registers (outstanding misses)");
+KNOB<FLT32> KnobTimingWidth(KNOB_MODE_WRITEONCE, "pintool",
+    "tmwidth","4", "instructions issued per cycle");
+KNOB<UINT32> KnobTimingWindow(KNOB_MODE_WRITEONCE, "pintool",
+    "tmwin","128", "instructions the core may run past an outstanding miss");
+
+KNOB<BOOL> KnobCompression(KNOB_MODE_WRITEONCE, "pintool",
+    "comp","0", "shadow L1 with a zero line/BDI compressed cache and an uncompressed one of the same geometry");
+
+KNOB<UINT32> KnobSectorSize(KNOB_MODE_WRITEONCE, "pintool",
+    "sector","0", "shadow L1 with a sectored cache filling sectors of this many bytes (0 = off)");
+KNOB<UINT32> KnobSectorLineSize(KNOB_MODE_WRITEONCE, "pintool",
+    "sectorline","128", "line (tag) size in bytes of the sectored cache");
+
+KNOB<string> KnobPartition(KNOB_MODE_WRITEONCE, "pintool",
+    "part","", "shadow L1 with a cache partitioned between weights, workspace, input, output and other data: ways or sets");
+KNOB<string> KnobPartitionShares(KNOB_MODE_WRITEONCE, "pintool",
+    "pshare","1:1:1:1:1", "weights:workspace:input:output:other ways (summing to the associativity) or set proportions");
+KNOB<string> KnobPartitionPolicies(KNOB_MODE_WRITEONCE, "pintool",
+    "ppolicy","alloc:alloc:alloc:alloc:alloc", "weights:workspace:input:output:other policies: alloc, noalloc or bypass");
+KNOB<string> KnobPartitionRange(KNOB_MODE_APPEND, "pintool",
+    "prange","", "class:low:high, addresses from low to high belong to class for the whole run");
+
+KNOB<BOOL> KnobInCache(KNOB_MODE_WRITEONCE, "pintool",
+    "icc","0", "count the gemm_nn MACs that could execute inside L1");
+KNOB<UINT32> KnobInCacheGroup(KNOB_MODE_WRITEONCE, "pintool",
+    "icgroup","4", "L1 sets per compute subarray, MAC operands must map to the same one");
+KNOB<UINT32> KnobInCacheLanes(KNOB_MODE_WRITEONCE, "pintool",
+    "iclanes","1024", "MACs the cache executes in parallel");
+KNOB<UINT32> KnobInCacheLatency(KNOB_MODE_WRITEONCE, "pintool",
+    "iclat","128", "cycles of one bit-serial MAC in cache");
+
+KNOB<string> KnobReuseFile(KNOB_MODE_WRITEONCE, "pintool",
+    "reuse","", "write reuse distance histograms and footprint curves per layer and class to this file");
+KNOB<UINT32> KnobReuseLineSize(KNOB_MODE_WRITEONCE, "pintool",
+    "reuseline","64", "line size in bytes of the reuse distance profile");
+KNOB<UINT32> KnobReuseStep(KNOB_MODE_WRITEONCE, "pintool",
+    "reusestep","100000", "accesses of a layer between two footprint samples");
+
+#ifdef USE_DRAM_MODEL
+KNOB<BOOL> KnobDram(KNOB_MODE_WRITEONCE, "pintool",
+    "dram","0", "model DRAM behind the last cache level");
+KNOB<UINT32> KnobDramChannels(KNOB_MODE_WRITEONCE, "pintool",
+    "dramch","1", "DRAM channels");
+KNOB<UINT32> KnobDramBanks(KNOB_MODE_WRITEONCE, "pintool",
+    "drambk","16", "DRAM banks per channel");
+KNOB<UINT32> KnobDramRowSize(KNOB_MODE_WRITEONCE, "pintool",
+    "dramrow","8192", "DRAM row size in bytes");
+KNOB<string> KnobDramPolicy(KNOB_MODE_WRITEONCE, "pintool",
+    "drampolicy","open", "DRAM page policy: open or closed");
+KNOB<UINT32> KnobDramCas(KNOB_MODE_WRITEONCE, "pintool",
+    "dramtcas","16", "DRAM CAS latency (tCAS) in DRAM clocks");
+KNOB<UINT32> KnobDramRcd(KNOB_MODE_WRITEONCE, "pintool",
+    "dramtrcd","16", "DRAM activate to read delay (tRCD) in DRAM clocks");
+KNOB<UINT32> KnobDramRp(KNOB_MODE_WRITEONCE, "pintool",
+    "dramtrp","16", "DRAM precharge time (tRP) in DRAM clocks");
+KNOB<UINT32> KnobDramFaw(KNOB_MODE_WRITEONCE, "pintool",
+    "dramtfaw","26", "DRAM four activate window (tFAW) in DRAM clocks");
+KNOB<UINT32> KnobDramBus(KNOB_MODE_WRITEONCE, "pintool",
+    "drambus","8", "DRAM data bus width in bytes per channel");
+KNOB<FLT32> KnobDramClock(KNOB_MODE_WRITEONCE, "pintool",
+    "dramtck","0.833", "DRAM clock period in ns");
+KNOB<FLT32> KnobDramActivateEnergy(KNOB_MODE_WRITEONCE, "pintool",
+    "dramact","2.0", "energy of an activate and its precharge in nJ");
+KNOB<FLT32> KnobDramByteEnergy(KNOB_MODE_WRITEONCE, "pintool",
+    "drambyte","15", "read or write energy per transferred byte in pJ");
+#endif
+
+KNOB<string> KnobLayerRoutine(KNOB_MODE_WRITEONCE, "pintool",
+    "layerfn","gemm_nn", "routine whose every call starts a layer, its M, N, K arguments drive the scratchpad");
+
+KNOB<string> KnobSweepFile(KNOB_MODE_WRITEONCE, "pintool",
+    "sweep", "", "sweep manifest, one configuration per line: l1c l1b l1a [l2c l2b l2a]");
+KNOB<string> KnobRecordFile(KNOB_MODE_WRITEONCE, "pintool",
+    "rec", "", "append one machine readable record per configuration to this file");
+KNOB<string> KnobRecordFormat(KNOB_MODE_WRITEONCE, "pintool",
+    "recfmt", "json", "record format: json (one object per line) or csv");
+KNOB<string> KnobTag(KNOB_MODE_WRITEONCE, "pintool",
+    "tag", "", "label stored in every record (e.g. network name)");
+
+KNOB<BOOL> KnobRoi(KNOB_MODE_WRITEONCE, "pintool",
+    "roi", "0", "fast-forward outside sim_roi_begin/sim_roi_end markers of the application");
+KNOB<string> KnobRoiTag(KNOB_MODE_WRITEONCE, "pintool",
+    "roitag", "", "only count regions of interest with this tag (e.g. convolutional)");
+KNOB<UINT32> KnobRoiSkip(KNOB_MODE_WRITEONCE, "pintool",
+    "roiskip", "0", "regions of interest to fast-forward through");
+KNOB<UINT32> KnobRoiWarm(KNOB_MODE_WRITEONCE, "pintool",
+    "roiwarm", "0", "regions of interest after -roiskip that only warm the caches");
+KNOB<UINT32> KnobRoiCount(KNOB_MODE_WRITEONCE, "pintool",
+    "roicount", "0", "regions of interest simulated in detail after warming (0 for all)");
+
+KNOB<string> KnobCheckpointSave(KNOB_MODE_WRITEONCE, "pintool",
+    "ckptsave", "", "write the state of every cache and TLB to this file");
+KNOB<INT32> KnobCheckpointRoi(KNOB_MODE_WRITEONCE, "pintool",
+    "ckptroi", "-1", "write the checkpoint when this region of interest starts (-1 for the end of the run)");
+KNOB<string> KnobCheckpointLoad(KNOB_MODE_WRITEONCE, "pintool",
+    "ckptload", "", "start from the cache and TLB state in this file instead of cold caches");
+
+KNOB<ADDRINT> KnobRegionLow(KNOB_MODE_WRITEONCE, "pintool",
+    "rlo", "0x4767b7", "first instruction address of the instrumented region");
+KNOB<ADDRINT> KnobRegionHigh(KNOB_MODE_WRITEONCE, "pintool",
+    "rhi", "0x476911", "last instruction address of the instrumented region");
+KNOB<string> KnobRegionRoutine(KNOB_MODE_APPEND, "pintool",
+    "rtn", "", "instrument the instructions of this routine instead of -rlo/-rhi, repeat for more routines");
+
 
 /* ===================================================================== */
 
@@ -93,10 +263,19 @@ namespace DL1
     const UINT32 max_associativity = 256; // associativity;
     const CACHE_ALLOC::STORE_ALLOCATION allocation = CACHE_ALLOC::STORE_ALLOCATE;
 
-    typedef CACHE_COLUMN_ASSOC(max_sets, allocation) CACHE;
+    typedef CACHE_COLUMN_ASSOC(max_sets, max_associativity, allocation) CACHE;
 }
 
-DL1::CACHE* dl1 = NULL;
+#elif defined(ESKEWCACHE)
+
+namespace DL1
+{
+    const UINT32 max_sets = KILO; // cacheSize / (lineSize * associativity);
+    const UINT32 max_associativity = 256; // associativity;
+    const CACHE_ALLOC::STORE_ALLOCATION allocation = CACHE_ALLOC::STORE_ALLOCATE;
+
+    typedef CACHE_SKEWED_ASSOC(max_sets, max_associativity, allocation) CACHE;
+}
 
 #else
 
@@ -109,8 +288,6 @@ namespace DL1
     typedef CACHE_ROUND_ROBIN(max_sets, max_associativity, allocation) CACHE;
 }
 
-DL1::CACHE* dl1 = NULL;
-
 #endif
 
 #ifdef USE_L2_CACHE
@@ -125,321 +302,1672 @@ namespace DL2
     typedef CACHE_ROUND_ROBIN(max_sets, max_associativity, allocation) CACHE;
 }
 
-DL2::CACHE* dl2 = NULL;
-
 #endif
 
+/*!
+ *  @brief Geometry of one simulated configuration, sizes in kilobytes
+ */
+struct DCACHE_CONFIG
+{
+    FLT32 l1CacheSize;
+    UINT32 l1LineSize;
+    UINT32 l1Associativity;
+    FLT32 l2CacheSize;
+    UINT32 l2LineSize;
+    UINT32 l2Associativity;
+};
+
+VICTIM_BUFFER::KIND BufferKind(const string & kind)
+{
+    return kind == "miss" ? VICTIM_BUFFER::KIND_MISS : VICTIM_BUFFER::KIND_VICTIM;
+}
 
-// UINT32 multi_called_times = 0;
-/* ===================================================================== */
-
-VOID LoadMultiFast(ADDRINT addr, UINT32 size, UINT32 isprefetch)
+/*!
+ *  @brief One simulated data cache hierarchy. Every configuration of a sweep
+ *  gets its own instance and sees the same access stream.
+ */
+class HIERARCHY
 {
-    // multi_called_times++;
+  private:
+    const DCACHE_CONFIG _config;
+    DL1::CACHE * _dl1;
 #ifdef USE_L2_CACHE
-    const BOOL dl1Hit = dl1->Access(addr, size, CACHE_BASE::ACCESS_TYPE_LOAD);
-    BOOL dl2Hit = false;
-    if(!dl1Hit)
+    DL2::CACHE * _dl2;
+#endif
+    CACHE_STATS _access[CACHE_BASE::ACCESS_TYPE_NUM][2];
+    TIMING * _timing;
+    DRAM * _dram;
+    COMPRESSED_CACHE * _compressed;
+    COMPRESSED_CACHE * _uncompressed;
+    SECTORED_CACHE * _sectored;
+    SECTORED_CACHE * _unsectored;
+    PARTITIONED_CACHE * _partitioned;
+    PARTITIONED_CACHE * _shared;
+    IN_CACHE_COMPUTE * _inCache;
+    LINE_LOG _log;
+    LINE_LOG _l1Log;
+
+    UINT32 LastLevelLineShift() const
     {
-        dl2Hit = dl2->Access(addr, size, CACHE_BASE::ACCESS_TYPE_LOAD);
-    }
-    Load_Hits = (dl1Hit || dl2Hit) ? Load_Hits + 1 : Load_Hits;
-    Load_Misses = (!dl1Hit && !dl2Hit) ? Load_Misses + 1 : Load_Misses;
+#ifdef USE_L2_CACHE
+        return _dl2->LineShift();
 #else
-    const BOOL dl1Hit = dl1->Access(addr, size, CACHE_BASE::ACCESS_TYPE_LOAD);
-    if(dl1Hit)
-    {
-        Load_Hits++;
+        return _dl1->LineShift();
+#endif
     }
-    else
+
+    /// Writes addr to addr+size-1 below L1: L2 lines that hold it become
+    /// dirty, the rest goes to DRAM
+    VOID WriteBelowL1(ADDRINT addr, UINT32 size)
     {
-        Load_Misses++;
+        const UINT32 shift = LastLevelLineShift();
+
+        for (ADDRINT line = addr >> shift; line <= (addr + size - 1) >> shift; line++)
+        {
+#ifdef USE_L2_CACHE
+            if (_dl2->SetDirty(line << shift)) continue;
+#endif
+            _dram->Write(line << shift);
+        }
     }
+
+    /*!
+     *  Write-back hierarchy in front of DRAM. Lines carry a dirty bit in the
+     *  cache models: a store marks its L1 lines, or writes below L1 when L1
+     *  did not allocate them, and a written L1 victim marks its L2 copy or
+     *  goes to DRAM if L2 dropped it. Fills of the last level are DRAM reads
+     *  and its written victims DRAM writes; a line moved into a victim cache
+     *  only leaves when the victim cache pushes it out.
+     */
+    VOID Memory(ADDRINT addr, UINT32 size, CACHE_BASE::ACCESS_TYPE accessType)
+    {
+        if (accessType == CACHE_BASE::ACCESS_TYPE_STORE)
+        {
+            const UINT32 l1Shift = _dl1->LineShift();
+            for (ADDRINT line = addr >> l1Shift; line <= (addr + size - 1) >> l1Shift; line++)
+            {
+#if defined(ECOLCACHE) || defined(ESKEWCACHE)
+#ifdef USE_L2_CACHE
+                // these L1 models keep no dirty bits, the store marks L2 as if it were inclusive
+                _dl2->SetDirty(line << l1Shift);
 #endif
-}
+#else
+                if (!_dl1->SetDirty(line << l1Shift)) WriteBelowL1(line << l1Shift, 1 << l1Shift);
+#endif
+            }
+        }
 
-/* ===================================================================== */
+#if defined(USE_L2_CACHE) && !defined(ECOLCACHE) && !defined(ESKEWCACHE)
+        for (UINT32 i = 0; i < _l1Log.writebacks.size(); i++)
+        {
+            WriteBelowL1(_l1Log.writebacks[i] << _dl1->LineShift(), _dl1->LineSize());
+        }
+        _l1Log.Clear();
+#endif
 
-VOID LoadSingleFast(ADDRINT addr)
-{
-    
-#ifdef USE_L2_CACHE
-    const BOOL dl1Hit = dl1->AccessSingleLine(addr, CACHE_BASE::ACCESS_TYPE_LOAD);    
-    BOOL dl2Hit = false;
-    if(!dl1Hit)
+        const UINT32 shift = LastLevelLineShift();
+        for (UINT32 i = 0; i < _log.fills.size(); i++)
+        {
+            _dram->Read(_log.fills[i] << shift);
+        }
+        for (UINT32 i = 0; i < _log.writebacks.size(); i++)
+        {
+            _dram->Write(_log.writebacks[i] << shift);
+        }
+        _log.Clear();
+    }
+
+  public:
+    HIERARCHY(const DCACHE_CONFIG & config);
+
+    const DCACHE_CONFIG & Config() const { return _config; }
+    const TIMING * Timing() const { return _timing; }
+    const DRAM * Dram() const { return _dram; }
+
+    /// Adds the timing model, instruction numbers of later accesses drive it
+    VOID AttachTiming(TIMING * timing) { _timing = timing; }
+
+    /// Adds a compressed L1 and its uncompressed baseline, both see every access
+    VOID AttachCompression(COMPRESSED_CACHE * compressed, COMPRESSED_CACHE * uncompressed)
     {
-        dl2Hit = dl2->AccessSingleLine(addr, CACHE_BASE::ACCESS_TYPE_LOAD);
+        _compressed = compressed;
+        _uncompressed = uncompressed;
     }
-    Load_Hits = (dl1Hit || dl2Hit) ? Load_Hits + 1 : Load_Hits;
-    Load_Misses = (!dl1Hit && !dl2Hit) ? Load_Misses + 1 : Load_Misses;
-#else
-    const BOOL dl1Hit = dl1->AccessSingleLine(addr, CACHE_BASE::ACCESS_TYPE_LOAD);
-    if(dl1Hit)
+
+    /// Adds a sectored L1 and a whole-line cache of the same geometry, both see every access
+    VOID AttachSectored(SECTORED_CACHE * sectored, SECTORED_CACHE * unsectored)
     {
-        Load_Hits++;
+        _sectored = sectored;
+        _unsectored = unsectored;
     }
-    else
+
+    /// Adds a partitioned L1 and a shared one of the same geometry, both see every access
+    VOID AttachPartitioned(PARTITIONED_CACHE * partitioned, PARTITIONED_CACHE * shared)
     {
-        Load_Misses++;
+        _partitioned = partitioned;
+        _shared = shared;
     }
-#endif
-}
 
+    /// Adds the in-cache computing model, it sees every access with its L1 outcome
+    VOID AttachInCache(IN_CACHE_COMPUTE * inCache) { _inCache = inCache; }
 
-/* ===================================================================== */
+#ifdef USE_DRAM_MODEL
+    /// Puts dram behind the last level
+    VOID AttachDram(DRAM * dram)
+    {
+        _dram = dram;
+#ifdef USE_L2_CACHE
+        _dl2->AttachLog(&_log);
+#if !defined(ECOLCACHE) && !defined(ESKEWCACHE)
+        _dl1->AttachLog(&_l1Log);
+#endif
+#else
+        _dl1->AttachLog(&_log);
+#endif
+    }
+#endif
 
-VOID StoreMultiFast(ADDRINT addr, UINT32 size)
-{
-    // multi_called_times++;
+    /// Access from addr to addr+size-1 by instruction, L2 only sees L1 misses
+    VOID Access(ADDRINT addr, UINT32 size, CACHE_BASE::ACCESS_TYPE accessType, UINT64 instruction)
+    {
+        TIMING::LEVEL level = TIMING::LEVEL_L1;
+        BOOL hit = _dl1->Access(addr, size, accessType);
+        if (_inCache) _inCache->Access(addr, size, accessType, hit);
+        if(!hit)
+        {
+            level = TIMING::LEVEL_MEMORY;
 #ifdef USE_L2_CACHE
-    const BOOL dl1Hit = dl1->Access(addr, size, CACHE_BASE::ACCESS_TYPE_STORE);
-    BOOL dl2Hit = false;
-    
-    if(!dl1Hit)
+            hit = _dl2->Access(addr, size, accessType);
+            if (hit) level = TIMING::LEVEL_L2;
+#endif
+        }
+        _access[accessType][hit]++;
+        if (_timing) _timing->Access(addr >> _dl1->LineShift(), level, instruction);
+        if (_dram) Memory(addr, size, accessType);
+        if (_compressed)
+        {
+            _compressed->Access(addr, size, accessType);
+            _uncompressed->Access(addr, size, accessType);
+        }
+        if (_sectored)
+        {
+            _sectored->Access(addr, size, accessType);
+            _unsectored->Access(addr, size, accessType);
+        }
+        if (_partitioned)
+        {
+            _partitioned->Access(addr, size, accessType);
+            _shared->Access(addr, size, accessType);
+        }
+    }
+
+    /// Access at addr that does not span cache lines
+    VOID AccessSingleLine(ADDRINT addr, CACHE_BASE::ACCESS_TYPE accessType, UINT64 instruction)
+    {
+        TIMING::LEVEL level = TIMING::LEVEL_L1;
+        BOOL hit = _dl1->AccessSingleLine(addr, accessType);
+        // single line accesses are at most 4 bytes, the size of a float operand
+        if (_inCache) _inCache->Access(addr, sizeof(float), accessType, hit);
+        if(!hit)
+        {
+            level = TIMING::LEVEL_MEMORY;
+#ifdef USE_L2_CACHE
+            hit = _dl2->AccessSingleLine(addr, accessType);
+            if (hit) level = TIMING::LEVEL_L2;
+#endif
+        }
+        _access[accessType][hit]++;
+        if (_timing) _timing->Access(addr >> _dl1->LineShift(), level, instruction);
+        if (_dram) Memory(addr, 1, accessType);
+        if (_compressed)
+        {
+            _compressed->AccessSingleLine(addr, accessType);
+            _uncompressed->AccessSingleLine(addr, accessType);
+        }
+        if (_sectored)
+        {
+            _sectored->AccessSingleLine(addr, accessType);
+            _unsectored->AccessSingleLine(addr, accessType);
+        }
+        if (_partitioned)
+        {
+            _partitioned->AccessSingleLine(addr, accessType);
+            _shared->AccessSingleLine(addr, accessType);
+        }
+    }
+
+    /// Hit rate of the compressed L1 minus that of its uncompressed baseline, in percent
+    double CompressionHitRateDelta() const
     {
-        dl2Hit = dl2->Access(addr, size, CACHE_BASE::ACCESS_TYPE_STORE);
+        return 100.0 * _compressed->Hits() / _compressed->Accesses()
+               - 100.0 * _uncompressed->Hits() / _uncompressed->Accesses();
     }
-    Store_Hits = (dl1Hit || dl2Hit) ? Store_Hits + 1 : Store_Hits;
-    Store_Misses = (!dl1Hit && !dl2Hit) ? Store_Misses + 1 : Store_Misses;
 
+    VOID ResetStats();
+    VOID Save(CHECKPOINT & ckpt) const;
+    bool Restore(CHECKPOINT & ckpt);
+    string StatsLong() const;
+    VOID Record(STATS_RECORD & record) const;
+};
+
+HIERARCHY::HIERARCHY(const DCACHE_CONFIG & config)
+  : _config(config), _timing(NULL), _dram(NULL), _compressed(NULL), _uncompressed(NULL),
+    _sectored(NULL), _unsectored(NULL), _partitioned(NULL), _shared(NULL),
+    _inCache(NULL)
+{
+    UINT32 l1cacheSize = config.l1CacheSize * KILO;
+
+#ifdef ECOLCACHE
+    _dl1 = new DL1::CACHE("L1 Col Data Cache", 
+                         l1cacheSize,
+                         config.l1LineSize,
+                         config.l1Associativity,
+                         Knobl1RehashMask.Value());
+#elif defined(ESKEWCACHE)
+    _dl1 = new DL1::CACHE("L1 Skewed Data Cache", 
+                         l1cacheSize,
+                         config.l1LineSize,
+                         config.l1Associativity);
 #else
-    const BOOL dl1Hit = dl1->Access(addr, size, CACHE_BASE::ACCESS_TYPE_STORE);
-    if(dl1Hit)
+    _dl1 = new DL1::CACHE("L1 Data Cache", 
+                         l1cacheSize,
+                         config.l1LineSize,
+                         config.l1Associativity);
+#endif
+#ifdef USE_L2_CACHE
+    UINT32 l2cacheSize = config.l2CacheSize * KILO;
+
+    _dl2 = new DL2::CACHE("L2 Data Cache", 
+                        l2cacheSize,
+                        config.l2LineSize,
+                        config.l2Associativity);
+
+    if (Knobl2BufferEntries.Value() > 0)
     {
-        Store_Hits++;
+        _dl2->AttachBuffer(new VICTIM_BUFFER("L2 Buffer",
+                                             BufferKind(Knobl2BufferKind.Value()),
+                                             Knobl2BufferEntries.Value()));
     }
-    else
+#endif
+#if !defined(ECOLCACHE) && !defined(ESKEWCACHE)
+    if (Knobl1BufferEntries.Value() > 0)
     {
-        Store_Misses++;
+        _dl1->AttachBuffer(new VICTIM_BUFFER("L1 Buffer",
+                                             BufferKind(Knobl1BufferKind.Value()),
+                                             Knobl1BufferEntries.Value()));
     }
 #endif
-}
 
-/* ===================================================================== */
+    for (UINT32 accessType = 0; accessType < CACHE_BASE::ACCESS_TYPE_NUM; accessType++)
+    {
+        _access[accessType][false] = 0;
+        _access[accessType][true] = 0;
+    }
+}
 
-VOID StoreSingleFast(ADDRINT addr)
+VOID HIERARCHY::ResetStats()
 {
+    _dl1->ResetStats();
 #ifdef USE_L2_CACHE
-    const BOOL dl1Hit = dl1->AccessSingleLine(addr, CACHE_BASE::ACCESS_TYPE_STORE);   
-    BOOL dl2Hit = false;
-    if(!dl1Hit)
+    _dl2->ResetStats();
+#endif
+    for (UINT32 accessType = 0; accessType < CACHE_BASE::ACCESS_TYPE_NUM; accessType++)
     {
-        dl2Hit = dl2->AccessSingleLine(addr, CACHE_BASE::ACCESS_TYPE_STORE);
+        _access[accessType][false] = 0;
+        _access[accessType][true] = 0;
     }
-    Store_Hits = (dl1Hit || dl2Hit) ? Store_Hits + 1 : Store_Hits;
-    Store_Misses = (!dl1Hit && !dl2Hit) ? Store_Misses + 1 : Store_Misses;
-
-#else
-    const BOOL dl1Hit = dl1->AccessSingleLine(addr, CACHE_BASE::ACCESS_TYPE_STORE);
-    if(dl1Hit)
+    if (_timing) _timing->ResetStats(0);
+    if (_dram) _dram->ResetStats();
+    if (_compressed)
     {
-        Store_Hits++;
+        _compressed->ResetStats();
+        _uncompressed->ResetStats();
     }
-    else
+    if (_sectored)
     {
-        Store_Misses++;
+        _sectored->ResetStats();
+        _unsectored->ResetStats();
     }
-#endif
+    if (_partitioned)
+    {
+        _partitioned->ResetStats();
+        _shared->ResetStats();
+    }
+    if (_inCache) _inCache->ResetStats();
 }
 
-
-/* ===================================================================== */
-
-VOID Instruction(INS ins, void * v)
+VOID HIERARCHY::Save(CHECKPOINT & ckpt) const
 {
-    ADDRINT curr_addr = INS_Address(ins);
-    std::string type = INS_Mnemonic(ins);
-    if (curr_addr >= 0x4767b7 && curr_addr <= 0x476911)
-    {
-        UINT32 memOperands = INS_MemoryOperandCount(ins);
+    _dl1->Save(ckpt);
+#ifdef USE_L2_CACHE
+    _dl2->Save(ckpt);
+#endif
 
-        // Instrument each memory operand. If the operand is both read and written
-        // it will be processed twice.
-        // Iterating over memory operands ensures that instructions on IA-32 with
-        // two read operands (such as SCAS and CMPS) are correctly handled.
-        for (UINT32 memOp = 0; memOp < memOperands; memOp++)
-        {
-            UINT32 size = INS_MemoryOperandSize(ins, memOp);
-            const BOOL   single = (size <= 4);
-            
-            if (INS_MemoryOperandIsRead(ins, memOp))
-            {
-                if( single )
-                {
-                    INS_InsertPredicatedCall(
-                        ins, IPOINT_BEFORE,  (AFUNPTR) LoadSingleFast,
-                        IARG_MEMORYOP_EA, memOp,
-                        IARG_END);
-                        
-                }
-                else
-                {
-                    UINT32 isprefetch;
-                    if(type == "PREFETCHT0")
-                    {
-                        isprefetch = 1;
-                        size = PREFETCH_SIZE;
-                    }
-                    else
-                    {
-                        isprefetch = 0;
-                    }
-                    INS_InsertPredicatedCall(
-                        ins, IPOINT_BEFORE,  (AFUNPTR) LoadMultiFast,
-                        IARG_MEMORYOP_EA, memOp,
-                        IARG_UINT32, size,
-                        IARG_UINT32, isprefetch,
-                        IARG_END);
-                }
-            }
-            if (INS_MemoryOperandIsWritten(ins, memOp))
-            {
-                if( single )
-                {
-                    INS_InsertPredicatedCall(
-                        ins, IPOINT_BEFORE,  (AFUNPTR) StoreSingleFast,
-                        IARG_MEMORYOP_EA, memOp,
-                        IARG_END);
-                        
-                }
-                else
-                {
-                    INS_InsertPredicatedCall(
-                        ins, IPOINT_BEFORE,  (AFUNPTR) StoreMultiFast,
-                        IARG_MEMORYOP_EA, memOp,
-                        IARG_UINT32, size,
-                        IARG_END);
-                }
-            }
-        }
+    // the side by side models, so they start as warm as the main hierarchy
+    ckpt.Begin("models", _compressed != NULL, _sectored != NULL, _partitioned != NULL);
+    if (_compressed)
+    {
+        _compressed->Save(ckpt);
+        _uncompressed->Save(ckpt);
+    }
+    if (_sectored)
+    {
+        _sectored->Save(ckpt);
+        _unsectored->Save(ckpt);
+    }
+    if (_partitioned)
+    {
+        _partitioned->Save(ckpt);
+        _shared->Save(ckpt);
     }
 }
 
-/* ===================================================================== */
-// string mydecstr(UINT64 v, UINT32 w)
-// {
-//     ostringstream o;
-//     o.width(w);
-//     o << v;
-//     string str(o.str());
-//     return str;
-// }
-
-VOID Fini(int code, VOID * v)
+bool HIERARCHY::Restore(CHECKPOINT & ckpt)
 {
+    if (!_dl1->Restore(ckpt)) return false;
+#ifdef USE_L2_CACHE
+    if (!_dl2->Restore(ckpt)) return false;
+#endif
 
+    if (!ckpt.Expect("models", _compressed != NULL, _sectored != NULL, _partitioned != NULL)) return false;
+    if (_compressed && !(_compressed->Restore(ckpt) && _uncompressed->Restore(ckpt))) return false;
+    if (_sectored && !(_sectored->Restore(ckpt) && _unsectored->Restore(ckpt))) return false;
+    if (_partitioned && !(_partitioned->Restore(ckpt) && _shared->Restore(ckpt))) return false;
+    return ckpt.Ok();
+}
 
-    std::ofstream out(KnobOutputFile.Value().c_str());
+string HIERARCHY::StatsLong() const
+{
+    string out;
 
-    // print D-cache profile
-    
-    out << "PIN:MEMLATENCIES 1.0. 0x0\n";
-            
-    out <<
+    out +=
         "#\n"
         "# L1 DCACHE stats\n"
         "#\n";
     
-    out << dl1->StatsLong("# ", CACHE_BASE::CACHE_TYPE_DCACHE);
+    out += _dl1->StatsLong("# ", CACHE_BASE::CACHE_TYPE_DCACHE);
 #ifdef USE_L2_CACHE
 
-    out <<
+    out +=
         "#\n"
         "# L2 DCACHE stats\n"
         "#\n";
     
-    out << dl2->StatsLong("# ", CACHE_BASE::CACHE_TYPE_DCACHE);
+    out += _dl2->StatsLong("# ", CACHE_BASE::CACHE_TYPE_DCACHE);
 
     const UINT64 headerWidth = 19U;
     const UINT64 numberWidth = 12U;
+    const UINT64 Load_Hits = _access[CACHE_BASE::ACCESS_TYPE_LOAD][true];
+    const UINT64 Load_Misses = _access[CACHE_BASE::ACCESS_TYPE_LOAD][false];
+    const UINT64 Store_Hits = _access[CACHE_BASE::ACCESS_TYPE_STORE][true];
+    const UINT64 Store_Misses = _access[CACHE_BASE::ACCESS_TYPE_STORE][false];
     const UINT64 Load_accesses = Load_Hits + Load_Misses;
     const UINT64 Store_accesses = Store_Hits + Store_Misses;
     const UINT64 Total_accesses = Load_accesses + Store_accesses;
     const UINT64 Total_hits = Load_Hits + Store_Hits;
     const UINT64 Total_misses = Load_Misses + Store_Misses;
 
-    out << "#\n# Total Stats\n#\n";
+    out += "#\n# Total Stats\n#\n";
 
-    out << "# " + ljstr("Total-L-Hits:      ", headerWidth)
+    out += "# " + ljstr("Total-L-Hits:      ", headerWidth)
            + mydecstr(Load_Hits, numberWidth) +
            "  " +fltstr(100.0 * Load_Hits / Load_accesses, 2, 6) + "%\n";
 
-    out << "# " + ljstr("Total-L-Misses:    ", headerWidth)
+    out += "# " + ljstr("Total-L-Misses:    ", headerWidth)
            + mydecstr(Load_Misses, numberWidth) +
            "  " +fltstr(100.0 * Load_Misses / Load_accesses, 2, 6) + "%\n";
 
-    out << "# " + ljstr("Total-S-Hits:      ", headerWidth)
+    out += "# " + ljstr("Total-S-Hits:      ", headerWidth)
            + mydecstr(Store_Hits, numberWidth) +
            "  " +fltstr(100.0 * Store_Hits / Store_accesses, 2, 6) + "%\n";
 
-    out << "# " + ljstr("Total-S-Misses:    ", headerWidth)
+    out += "# " + ljstr("Total-S-Misses:    ", headerWidth)
            + mydecstr(Store_Misses, numberWidth) +
            "  " +fltstr(100.0 * Store_Misses / Store_accesses, 2, 6) + "%\n";
 
-    out << "# " + ljstr("Hits-Rate:  ", headerWidth)
+    out += "# " + ljstr("Hits-Rate:  ", headerWidth)
            + mydecstr(Total_hits, numberWidth) +
            "  " +fltstr(100.0 * Total_hits / Total_accesses, 2, 6) + "%\n";
 
-    out << "# " + ljstr("Miss-Rate:  ", headerWidth)
+    out += "# " + ljstr("Miss-Rate:  ", headerWidth)
            + mydecstr(Total_misses, numberWidth) +
            "  " +fltstr(100.0 * Total_misses / Total_accesses, 2, 6) + "%\n";
 
-
 #endif
-    // out << " multi called times : " << multi_called_times << "\n";
 
-    out.close();
+    if (_timing)
+    {
+        out += "#\n# Timing stats\n#\n";
+        out += _timing->StatsLong("# ", _timing->Counters());
+    }
 
+    if (_dram)
+    {
+        out += "#\n# DRAM stats\n#\n";
+        out += _dram->StatsLong("# ", _dram->Counters());
+    }
 
-}
+    if (_compressed)
+    {
+        const UINT32 headerWidth = 19;
+        const UINT32 numberWidth = 12;
 
-/* ===================================================================== */
+        out += "#\n# Compressed L1 stats\n#\n";
+        out += _compressed->StatsLong("# ");
+        out += "# " + ljstr("Hit-Rate-Delta:   ", headerWidth) + fltstr(CompressionHitRateDelta(), 2, numberWidth) + "%\n";
+    }
 
-int main(int argc, char *argv[])
-{
-    PIN_InitSymbols();
+    if (_sectored)
+    {
+        const UINT32 headerWidth = 19;
+        const UINT32 numberWidth = 12;
+
+        out += "#\n# Sectored L1 stats\n#\n";
+        out += _sectored->StatsLong("# ");
+        out += "# " + ljstr("Line-Hit-Rate:    ", headerWidth)
+               + fltstr(100.0 * _unsectored->Hits() / _unsectored->Accesses(), 2, numberWidth) + "%\n";
+        out += "# " + ljstr("Line-Fill-Bytes:  ", headerWidth) + mydecstr(_unsectored->FillBytes(), numberWidth) + "\n";
+        out += "# " + ljstr("Line-WB-Bytes:    ", headerWidth) + mydecstr(_unsectored->WritebackBytes(), numberWidth) + "\n";
+        out += "# " + ljstr("Traffic-Saved:    ", headerWidth)
+               + fltstr(100.0 - 100.0 * _sectored->TrafficBytes() / _unsectored->TrafficBytes(), 2, numberWidth) + "%\n";
+    }
 
-    if( PIN_Init(argc,argv) )
+    if (_partitioned)
     {
-        return Usage();
+        out += "#\n# Partitioned L1 stats\n#\n";
+        out += _partitioned->StatsLong("# ");
+        out += "#\n# Shared L1 stats (partitioning baseline)\n#\n";
+        out += _shared->StatsLong("# ");
     }
-    
-    Load_Hits = 0;
 
+    if (_inCache)
+    {
+        out += "#\n# In-cache computing stats\n#\n";
+        out += _inCache->StatsLong("# ");
+    }
+    return out;
+}
 
-    Load_Misses = 0;
-    Store_Hits = 0;
-    Store_Misses = 0;
+/*!
+ *  @brief Adds every cache level and the hierarchy totals to record
+ */
+VOID HIERARCHY::Record(STATS_RECORD & record) const
+{
+    _dl1->Record(record, "l1_");
+#ifdef USE_L2_CACHE
+    _dl2->Record(record, "l2_");
+#endif
 
-#ifdef ECOLCACHE
-    UINT32 l1cacheSize = Knobl1CacheSize.Value() * KILO;
+    CACHE_STATS hits = 0;
+    CACHE_STATS misses = 0;
+    for (UINT32 i = 0; i < CACHE_BASE::ACCESS_TYPE_NUM; i++)
+    {
+        const string type(i == CACHE_BASE::ACCESS_TYPE_LOAD ? "load" : "store");
 
-    dl1 = new DL1::CACHE("L1 Col Data Cache", 
-                         l1cacheSize,
-                         Knobl1LineSize.Value(),
-                         1);
+        record.Add("total_" + type + "_hits", _access[i][true]);
+        record.Add("total_" + type + "_misses", _access[i][false]);
+        hits += _access[i][true];
+        misses += _access[i][false];
+    }
+    record.Add("total_hits", hits);
+    record.Add("total_misses", misses);
+    record.Add("total_hit_rate", 100.0 * hits / (hits + misses));
 
+    if (_timing) _timing->Record(record, "tm_", _timing->Counters());
+    if (_dram) _dram->Record(record, "dram_", _dram->Counters());
+    if (_compressed)
+    {
+        _compressed->Record(record, "comp_");
+        record.Add("comp_base_hits", _uncompressed->Hits());
+        record.Add("comp_hit_rate_delta", CompressionHitRateDelta());
+    }
+    if (_sectored)
+    {
+        _sectored->Record(record, "sec_");
+        record.Add("sec_line_hits", _unsectored->Hits());
+        record.Add("sec_line_fill_bytes", _unsectored->FillBytes());
+        record.Add("sec_line_writeback_bytes", _unsectored->WritebackBytes());
+    }
+    if (_partitioned)
+    {
+        _partitioned->Record(record, "part_");
+        for (UINT32 i = 0; i < ADDRESS_CLASSES::CLASS_NUM; i++)
+        {
+            const ADDRESS_CLASSES::CLASS addressClass = ADDRESS_CLASSES::CLASS(i);
+            record.Add("part_shared_" + ADDRESS_CLASSES::Name(addressClass) + "_hits", _shared->ClassHits(addressClass));
+        }
+    }
+    if (_inCache) _inCache->Record(record, "icc_");
+}
 
-#else
-    UINT32 l1cacheSize = Knobl1CacheSize.Value() * KILO;
+std::vector<HIERARCHY*> hierarchies;
+
+SCRATCHPAD * spm = NULL;
+
+DATA_TLB * tlb = NULL;
+
+ADDRESS_CLASSES addressClasses;
+
+REUSE_PROFILER * reuse = NULL;
+
+/*!
+ *  @brief One call of the layer routine: its gemm shape, its scratchpad
+ *  traffic and the TLB counters when it started
+ */
+struct LAYER
+{
+    UINT32 M;
+    UINT32 N;
+    UINT32 K;
+    SCRATCHPAD::TRAFFIC traffic;
+    DATA_TLB::COUNTERS tlbStart;
+    std::vector<TIMING::COUNTERS> timingStart;
+    std::vector<DRAM::COUNTERS> dramStart;
+};
+
+std::vector<LAYER> layers;
+
+/*!
+ *  @brief What the analysis routines do. Fast-forward inserts no analysis
+ *  calls at all, warming updates the models and drops their counters when
+ *  detailed simulation starts, detailed simulation counts everything.
+ */
+typedef enum
+{
+    SIM_FAST_FORWARD,
+    SIM_WARMING,
+    SIM_DETAILED
+} SIM_MODE;
+
+SIM_MODE simMode = SIM_DETAILED;
+BOOL detailedStarted = true;
+
+/// Set when a model reads the layer routine or im2col calls: the scratchpad,
+/// the TLB, timing and DRAM per layer, partitioning, in-cache computing and
+/// the reuse profiler. Otherwise the calls are not instrumented
+BOOL layerCalls = false;
+
+/// Entry points of the layer routine and the region of interest markers
+ADDRINT layerAddress = 0;
+ADDRINT im2colAddress = 0;
+ADDRINT roiBeginAddress = 0;
+ADDRINT roiEndAddress = 0;
+
+/// Bounds of the instrumented region: -rlo/-rhi, or with -rtn the span of
+/// the routines found so far, which only the records report
+ADDRINT regionLow = 0;
+ADDRINT regionHigh = 0;
+
+/// First and last instruction of every -rtn routine found in a loaded image
+std::vector<std::pair<ADDRINT, ADDRINT> > regionRoutines;
+
+BOOL InRegion(ADDRINT addr)
+{
+    if (KnobRegionRoutine.NumberOfValues() == 0) return addr >= regionLow && addr <= regionHigh;
+    for (UINT32 i = 0; i < regionRoutines.size(); i++)
+    {
+        if (addr >= regionRoutines[i].first && addr <= regionRoutines[i].second) return true;
+    }
+    return false;
+}
+
+/// Instructions of the instrumented region, only counted for the timing model
+UINT64 instructionCount = 0;
+
+UINT64 roiSeen = 0;
+UINT64 roiWarmed = 0;
+UINT64 roiDetailed = 0;
+
+/// Set once the -ckptroi checkpoint has been written
+BOOL checkpointSaved = false;
+
+string binaryName = "";
+
+/* ===================================================================== */
+
+/*!
+ *  @brief Reads a sweep manifest. Every line that is not empty and does not
+ *  start with '#' is "l1c l1b l1a [l2c l2b l2a]"; omitted L2 values are taken
+ *  from the command line knobs.
+ *  @returns false if the file cannot be opened or a line is malformed
+ */
+BOOL ReadSweepManifest(const string & fileName, const DCACHE_CONFIG & defaults, std::vector<DCACHE_CONFIG> & configs)
+{
+    std::ifstream in(fileName.c_str());
+    if (!in.is_open())
+    {
+        cerr << "Cannot open sweep manifest " << fileName << endl;
+        return false;
+    }
+
+    string line;
+    UINT32 lineNumber = 0;
+    while (std::getline(in, line))
+    {
+        lineNumber++;
+        const size_t first = line.find_first_not_of(" \t\r");
+        if (first == string::npos || line[first] == '#') continue;
+
+        DCACHE_CONFIG config = defaults;
+        std::istringstream fields(line);
+        fields >> config.l1CacheSize >> config.l1LineSize >> config.l1Associativity;
+        if (fields.fail())
+        {
+            cerr << fileName << ":" << lineNumber << ": expected l1c l1b l1a [l2c l2b l2a]" << endl;
+            return false;
+        }
+        FLT32 l2CacheSize;
+        UINT32 l2LineSize, l2Associativity;
+        if (fields >> l2CacheSize >> l2LineSize >> l2Associativity)
+        {
+            config.l2CacheSize = l2CacheSize;
+            config.l2LineSize = l2LineSize;
+            config.l2Associativity = l2Associativity;
+        }
+        configs.push_back(config);
+    }
+    return true;
+}
+
+/* ===================================================================== */
+
+/*!
+ *  @return true if a cache of sizeKB kilobytes holds at least one set of
+ *  associativity lines. A smaller one would wrap its set index mask around.
+ */
+BOOL HasSets(FLT32 sizeKB, UINT32 lineSize, UINT32 associativity)
+{
+    return lineSize > 0 && associativity > 0 && (UINT32)(sizeKB * KILO) / (lineSize * associativity) >= 1;
+}
+
+/* ===================================================================== */
+
+std::vector<string> SplitFields(const string & value)
+{
+    std::vector<string> fields;
+    std::istringstream in(value);
+    string field;
+    while (std::getline(in, field, ':'))
+    {
+        fields.push_back(field);
+    }
+    return fields;
+}
+
+/*!
+ *  @brief Reads the partition shares and policies of the four address
+ *  classes and the fixed class ranges from their knobs
+ */
+BOOL ReadPartition(std::vector<UINT32> & shares, std::vector<PARTITIONED_CACHE::POLICY> & policies)
+{
+    const std::vector<string> shareFields = SplitFields(KnobPartitionShares.Value());
+    const std::vector<string> policyFields = SplitFields(KnobPartitionPolicies.Value());
+    if (shareFields.size() != ADDRESS_CLASSES::CLASS_NUM || policyFields.size() != ADDRESS_CLASSES::CLASS_NUM)
+    {
+        cerr << "Partition shares and policies need one field per class: weights:workspace:input:output:other" << endl;
+        return false;
+    }
+
+    for (UINT32 i = 0; i < ADDRESS_CLASSES::CLASS_NUM; i++)
+    {
+        shares.push_back(Uint32FromString(shareFields[i]));
+        policies.push_back(PARTITIONED_CACHE::FindPolicy(policyFields[i]));
+        if (policies.back() == PARTITIONED_CACHE::POLICY_NUM)
+        {
+            cerr << "Unknown partition policy " << policyFields[i] << endl;
+            return false;
+        }
+    }
+
+    for (UINT32 i = 0; i < KnobPartitionRange.NumberOfValues(); i++)
+    {
+        const std::vector<string> fields = SplitFields(KnobPartitionRange.Value(i));
+        if (fields.size() != 3 || ADDRESS_CLASSES::Find(fields[0]) == ADDRESS_CLASSES::CLASS_NUM)
+        {
+            cerr << "Expected -prange class:low:high, got " << KnobPartitionRange.Value(i) << endl;
+            return false;
+        }
+        addressClasses.AddRange(ADDRESS_CLASSES::Find(fields[0]),
+                                AddrintFromString(fields[1]), AddrintFromString(fields[2]));
+    }
+    return true;
+}
+
+/* ===================================================================== */
+
+/*!
+ *  @brief Writes the state of all hierarchies and the TLB. Counters are not
+ *  part of a checkpoint, only what the models hold.
+ */
+VOID SaveCheckpoint(const string & fileName)
+{
+    CHECKPOINT ckpt(fileName, true);
+
+    ckpt.Begin("dcache", hierarchies.size(), tlb != NULL, 0);
+    for (UINT32 i = 0; i < hierarchies.size(); i++)
+    {
+        hierarchies[i]->Save(ckpt);
+    }
+    if (tlb) tlb->Save(ckpt);
+
+    if (!ckpt.Ok())
+    {
+        cerr << "Cannot write checkpoint " << fileName << endl;
+    }
+}
+
+/*!
+ *  @returns false unless the file was written for the same configurations
+ */
+BOOL RestoreCheckpoint(const string & fileName)
+{
+    CHECKPOINT ckpt(fileName, false);
+
+    if (!ckpt.Expect("dcache", hierarchies.size(), tlb != NULL, 0)) return false;
+    for (UINT32 i = 0; i < hierarchies.size(); i++)
+    {
+        if (!hierarchies[i]->Restore(ckpt)) return false;
+    }
+    return tlb == NULL || tlb->Restore(ckpt);
+}
+
+/* ===================================================================== */
+
+VOID LoadMultiFast(ADDRINT addr, UINT32 size, UINT32 isprefetch)
+{
+    if (tlb) tlb->Access(addr, size, CACHE_BASE::ACCESS_TYPE_LOAD);
+    if (reuse) reuse->Access(addr, size);
+
+    for (UINT32 i = 0; i < hierarchies.size(); i++)
+    {
+        hierarchies[i]->Access(addr, size, CACHE_BASE::ACCESS_TYPE_LOAD, instructionCount);
+    }
+}
+
+/* ===================================================================== */
+
+VOID LoadSingleFast(ADDRINT addr)
+{
+    if (tlb) tlb->AccessSingleLine(addr, CACHE_BASE::ACCESS_TYPE_LOAD);
+    if (reuse) reuse->Access(addr, 1);
+
+    for (UINT32 i = 0; i < hierarchies.size(); i++)
+    {
+        hierarchies[i]->AccessSingleLine(addr, CACHE_BASE::ACCESS_TYPE_LOAD, instructionCount);
+    }
+}
+
+
+/* ===================================================================== */
+
+VOID StoreMultiFast(ADDRINT addr, UINT32 size)
+{
+    if (tlb) tlb->Access(addr, size, CACHE_BASE::ACCESS_TYPE_STORE);
+    if (reuse) reuse->Access(addr, size);
+
+    for (UINT32 i = 0; i < hierarchies.size(); i++)
+    {
+        hierarchies[i]->Access(addr, size, CACHE_BASE::ACCESS_TYPE_STORE, instructionCount);
+    }
+}
+
+/* ===================================================================== */
+
+VOID StoreSingleFast(ADDRINT addr)
+{
+    if (tlb) tlb->AccessSingleLine(addr, CACHE_BASE::ACCESS_TYPE_STORE);
+    if (reuse) reuse->Access(addr, 1);
+
+    for (UINT32 i = 0; i < hierarchies.size(); i++)
+    {
+        hierarchies[i]->AccessSingleLine(addr, CACHE_BASE::ACCESS_TYPE_STORE, instructionCount);
+    }
+}
+
+
+/* ===================================================================== */
+
+VOID LayerCall(ADDRINT M, ADDRINT N, ADDRINT K,
+               ADDRINT A, ADDRINT lda, ADDRINT B, ADDRINT ldb, ADDRINT C, ADDRINT ldc)
+{
+    // gemm_nn(M, N, K, ALPHA, A, lda, B, ldb, C, ldc) on row major floats:
+    // A is M x K weights, B is K x N workspace, C is M x N output
+    addressClasses.SetLayerRange(ADDRESS_CLASSES::CLASS_WEIGHTS, A, A + (UINT32)M * (UINT32)lda * sizeof(float) - 1);
+    addressClasses.SetLayerRange(ADDRESS_CLASSES::CLASS_WORKSPACE, B, B + (UINT32)K * (UINT32)ldb * sizeof(float) - 1);
+    addressClasses.SetLayerRange(ADDRESS_CLASSES::CLASS_OUTPUT, C, C + (UINT32)M * (UINT32)ldc * sizeof(float) - 1);
+
+    if (simMode != SIM_DETAILED) return;
+
+    LAYER layer;
+    layer.M = M;
+    layer.N = N;
+    layer.K = K;
+    if (spm) layer.traffic = spm->Gemm(M, N, K);
+    if (tlb) layer.tlbStart = tlb->Counters();
+    for (UINT32 i = 0; i < hierarchies.size(); i++)
+    {
+        if (hierarchies[i]->Timing()) layer.timingStart.push_back(hierarchies[i]->Timing()->Counters(instructionCount));
+        if (hierarchies[i]->Dram()) layer.dramStart.push_back(hierarchies[i]->Dram()->Counters());
+    }
+    layers.push_back(layer);
+    if (reuse) reuse->Layer();
+}
+
+/* ===================================================================== */
+
+/// im2col_cpu(data_im, channels, height, width, ...) reads a channels x height x width image
+VOID Im2colCall(ADDRINT image, ADDRINT channels, ADDRINT height, ADDRINT width)
+{
+    addressClasses.SetLayerRange(ADDRESS_CLASSES::CLASS_INPUT, image,
+                                 image + (UINT32)channels * (UINT32)height * (UINT32)width * sizeof(float) - 1);
+}
+
+/* ===================================================================== */
+
+VOID CountInstruction()
+{
+    instructionCount++;
+}
+
+/* ===================================================================== */
+
+/*!
+ *  @brief Switches the simulation mode. Leaving or entering fast-forward
+ *  flushes the code cache so traces are instrumented again for the new mode.
+ */
+VOID SetMode(SIM_MODE mode)
+{
+    if (mode == SIM_DETAILED && !detailedStarted)
+    {
+        instructionCount = 0;
+        for (UINT32 i = 0; i < hierarchies.size(); i++)
+        {
+            hierarchies[i]->ResetStats();
+        }
+        if (tlb) tlb->ResetStats();
+        if (reuse) reuse->ResetStats();
+        detailedStarted = true;
+    }
+
+    const BOOL reinstrument = (mode == SIM_FAST_FORWARD) != (simMode == SIM_FAST_FORWARD);
+    simMode = mode;
+    if (reinstrument) PIN_RemoveInstrumentation();
+}
+
+/* ===================================================================== */
+
+VOID RoiBegin(ADDRINT tagAddress)
+{
+    char tag[64];
+    const size_t copied = PIN_SafeCopy(tag, (VOID *) tagAddress, sizeof(tag) - 1);
+    tag[copied] = '\0';
+
+    if (!KnobRoiTag.Value().empty() && KnobRoiTag.Value() != tag) return;
+
+    const UINT64 index = roiSeen++;
+    const UINT64 warmEnd = KnobRoiSkip.Value() + KnobRoiWarm.Value();
+
+    if (!KnobCheckpointSave.Value().empty() && index == (UINT64)KnobCheckpointRoi.Value())
+    {
+        SaveCheckpoint(KnobCheckpointSave.Value());
+        checkpointSaved = true;
+    }
+
+    if (index < KnobRoiSkip.Value()) return;
+
+    if (index < warmEnd)
+    {
+        roiWarmed++;
+        SetMode(SIM_WARMING);
+    }
+    else if (KnobRoiCount.Value() == 0 || index < warmEnd + KnobRoiCount.Value())
+    {
+        roiDetailed++;
+        SetMode(SIM_DETAILED);
+    }
+}
+
+/* ===================================================================== */
+
+VOID RoiEnd()
+{
+    if (simMode != SIM_FAST_FORWARD) SetMode(SIM_FAST_FORWARD);
+}
+
+/* ===================================================================== */
+
+VOID Instruction(INS ins, void * v)
+{
+    ADDRINT curr_addr = INS_Address(ins);
+    std::string type = INS_Mnemonic(ins);
+
+    // markers are instrumented in every mode so they can leave fast-forward
+    if (curr_addr == roiBeginAddress)
+    {
+        INS_InsertCall(ins, IPOINT_BEFORE, (AFUNPTR) RoiBegin,
+                       IARG_FUNCARG_ENTRYPOINT_VALUE, 0,
+                       IARG_END);
+    }
+    if (curr_addr == roiEndAddress)
+    {
+        INS_InsertCall(ins, IPOINT_BEFORE, (AFUNPTR) RoiEnd, IARG_END);
+    }
+    if (curr_addr == layerAddress)
+    {
+        // the float ALPHA is passed in a vector register, so M, N, K, A,
+        // lda, B, ldb, C and ldc take the integer argument slots 0 to 8
+        INS_InsertCall(ins, IPOINT_BEFORE, (AFUNPTR) LayerCall,
+                       IARG_FUNCARG_ENTRYPOINT_VALUE, 0,
+                       IARG_FUNCARG_ENTRYPOINT_VALUE, 1,
+                       IARG_FUNCARG_ENTRYPOINT_VALUE, 2,
+                       IARG_FUNCARG_ENTRYPOINT_VALUE, 3,
+                       IARG_FUNCARG_ENTRYPOINT_VALUE, 4,
+                       IARG_FUNCARG_ENTRYPOINT_VALUE, 5,
+                       IARG_FUNCARG_ENTRYPOINT_VALUE, 6,
+                       IARG_FUNCARG_ENTRYPOINT_VALUE, 7,
+                       IARG_FUNCARG_ENTRYPOINT_VALUE, 8,
+                       IARG_END);
+    }
+
+    if (curr_addr == im2colAddress)
+    {
+        INS_InsertCall(ins, IPOINT_BEFORE, (AFUNPTR) Im2colCall,
+                       IARG_FUNCARG_ENTRYPOINT_VALUE, 0,
+                       IARG_FUNCARG_ENTRYPOINT_VALUE, 1,
+                       IARG_FUNCARG_ENTRYPOINT_VALUE, 2,
+                       IARG_FUNCARG_ENTRYPOINT_VALUE, 3,
+                       IARG_END);
+    }
+
+    if (simMode == SIM_FAST_FORWARD) return;
+
+    if (InRegion(curr_addr))
+    {
+        if (KnobTiming.Value())
+        {
+            INS_InsertCall(ins, IPOINT_BEFORE, (AFUNPTR) CountInstruction, IARG_END);
+        }
+
+        UINT32 memOperands = INS_MemoryOperandCount(ins);
+
+        // Instrument each memory operand. If the operand is both read and written
+        // it will be processed twice.
+        // Iterating over memory operands ensures that instructions on IA-32 with
+        // two read operands (such as SCAS and CMPS) are correctly handled.
+        for (UINT32 memOp = 0; memOp < memOperands; memOp++)
+        {
+            UINT32 size = INS_MemoryOperandSize(ins, memOp);
+            const BOOL   single = (size <= 4);
+            
+            if (INS_MemoryOperandIsRead(ins, memOp))
+            {
+                if( single )
+                {
+                    INS_InsertPredicatedCall(
+                        ins, IPOINT_BEFORE,  (AFUNPTR) LoadSingleFast,
+                        IARG_MEMORYOP_EA, memOp,
+                        IARG_END);
+                        
+                }
+                else
+                {
+                    UINT32 isprefetch;
+                    if(type == "PREFETCHT0")
+                    {
+                        isprefetch = 1;
+                        size = PREFETCH_SIZE;
+                    }
+                    else
+                    {
+                        isprefetch = 0;
+                    }
+                    INS_InsertPredicatedCall(
+                        ins, IPOINT_BEFORE,  (AFUNPTR) LoadMultiFast,
+                        IARG_MEMORYOP_EA, memOp,
+                        IARG_UINT32, size,
+                        IARG_UINT32, isprefetch,
+                        IARG_END);
+                }
+            }
+            if (INS_MemoryOperandIsWritten(ins, memOp))
+            {
+                if( single )
+                {
+                    INS_InsertPredicatedCall(
+                        ins, IPOINT_BEFORE,  (AFUNPTR) StoreSingleFast,
+                        IARG_MEMORYOP_EA, memOp,
+                        IARG_END);
+                        
+                }
+                else
+                {
+                    INS_InsertPredicatedCall(
+                        ins, IPOINT_BEFORE,  (AFUNPTR) StoreMultiFast,
+                        IARG_MEMORYOP_EA, memOp,
+                        IARG_UINT32, size,
+                        IARG_END);
+                }
+            }
+        }
+    }
+}
+
+/* ===================================================================== */
+
+VOID Image(IMG img, VOID * v)
+{
+    if (IMG_IsMainExecutable(img))
+    {
+        binaryName = IMG_Name(img);
+    }
 
-    dl1 = new DL1::CACHE("L1 Data Cache", 
-                         l1cacheSize,
-                         Knobl1LineSize.Value(),
-                         Knobl1Associativity.Value());
+    for (UINT32 i = 0; i < KnobRegionRoutine.NumberOfValues(); i++)
+    {
+        RTN region = RTN_FindByName(img, KnobRegionRoutine.Value(i).c_str());
+        if (!RTN_Valid(region)) continue;
+
+        const ADDRINT low = RTN_Address(region);
+        const ADDRINT high = low + RTN_Size(region) - 1;
+        regionRoutines.push_back(std::make_pair(low, high));
+        regionLow = std::min(regionLow, low);
+        regionHigh = std::max(regionHigh, high);
+    }
+
+    if (layerCalls)
+    {
+        RTN rtn = RTN_FindByName(img, KnobLayerRoutine.Value().c_str());
+        if (RTN_Valid(rtn)) layerAddress = RTN_Address(rtn);
+
+        RTN im2col = RTN_FindByName(img, "im2col_cpu");
+        if (RTN_Valid(im2col)) im2colAddress = RTN_Address(im2col);
+    }
+
+    if (KnobRoi.Value())
+    {
+        RTN begin = RTN_FindByName(img, "sim_roi_begin");
+        RTN end = RTN_FindByName(img, "sim_roi_end");
+        if (RTN_Valid(begin)) roiBeginAddress = RTN_Address(begin);
+        if (RTN_Valid(end)) roiEndAddress = RTN_Address(end);
+    }
+}
+
+/* ===================================================================== */
+
+/*!
+ *  @brief Appends one record per configuration to the record file. A CSV
+ *  header is written when the file is new, and again with a warning whenever
+ *  the columns differ from the last header in the file, so records of another
+ *  format or set of knobs are never appended under the wrong header.
+ */
+VOID WriteRecords(const string & fileName, const string & format)
+{
+    const BOOL csv = (format == "csv");
+
+    std::ifstream existing(fileName.c_str());
+    const BOOL empty = !existing.is_open() || existing.peek() == std::ifstream::traits_type::eof();
+    string header, line;
+    BOOL json = false;
+    while (!empty && std::getline(existing, line))
+    {
+        if (line.empty()) continue;
+        if (line[0] == '{') json = true;
+        else if (line.compare(0, 4, "tag,") == 0) header = line;
+    }
+    existing.close();
+
+    if (!empty && csv == json)
+    {
+        cerr << "Warning: appending " << format << " records to " << fileName
+             << ", which already holds " << (json ? "json" : "csv") << " records" << endl;
+    }
 
+    std::ofstream out(fileName.c_str(), std::ios::app);
+
+    for (UINT32 i = 0; i < hierarchies.size(); i++)
+    {
+        const DCACHE_CONFIG & config = hierarchies[i]->Config();
+        STATS_RECORD record;
+
+        record.Add("tag", KnobTag.Value());
+        record.Add("binary", binaryName);
+        record.Add("region_low", hexstr(regionLow));
+        record.Add("region_high", hexstr(regionHigh));
+        record.Add("config", i);
+        record.Add("l1c_kb", (double)config.l1CacheSize, 2);
+#ifdef USE_L2_CACHE
+        record.Add("l2c_kb", (double)config.l2CacheSize, 2);
 #endif
+        hierarchies[i]->Record(record);
+        if (spm) spm->Record(record, "spm_");
+        if (tlb) tlb->Record(record, "tlb_");
+
+        if (csv)
+        {
+            if (record.CsvHeader() != header)
+            {
+                if (!header.empty())
+                {
+                    cerr << "Warning: the columns of " << fileName
+                         << " changed, a new header is written before configuration " << i << endl;
+                }
+                header = record.CsvHeader();
+                out << header << "\n";
+            }
+            out << record.CsvRow() << "\n";
+        }
+        else
+        {
+            out << record.Json() << "\n";
+        }
+    }
+
+    out.close();
+}
+
+/* ===================================================================== */
+
+VOID Fini(int code, VOID * v)
+{
+
+
+    std::ofstream out(KnobOutputFile.Value().c_str());
+
+    // print D-cache profile
+    
+    out << "PIN:MEMLATENCIES 1.0. 0x0\n";
+
+    if (KnobRoi.Value())
+    {
+        out << "#\n# Regions of interest: " << roiSeen << " seen, " << roiWarmed << " warmed, "
+            << roiDetailed << " detailed\n";
+    }
+
+    for (UINT32 i = 0; i < hierarchies.size(); i++)
+    {
+        const DCACHE_CONFIG & config = hierarchies[i]->Config();
+
+        if (hierarchies.size() > 1)
+        {
+            out << "#\n# Configuration " << i << ": l1c " << config.l1CacheSize
+                << " l1b " << config.l1LineSize << " l1a " << config.l1Associativity
 #ifdef USE_L2_CACHE
+                << " l2c " << config.l2CacheSize << " l2b " << config.l2LineSize
+                << " l2a " << config.l2Associativity
+#endif
+                << "\n";
+        }
+        out << hierarchies[i]->StatsLong();
+    }
+
+    if (spm)
+    {
+        out <<
+            "#\n"
+            "# Scratchpad stats\n"
+            "#\n";
+        out << spm->StatsLong("# ");
+
+        out << "#\n# gemm   M   N   K   DMA-Bytes   Bytes/MAC   A-Reuse   B-Reuse   C-Reuse\n";
+        for (UINT32 i = 0; i < layers.size(); i++)
+        {
+            const LAYER & layer = layers[i];
+            const SCRATCHPAD::TRAFFIC & t = layer.traffic;
 
-    UINT32 l2cacheSize = Knobl2CacheSize.Value() * KILO;
+            out << "# " << i << " " << layer.M << " " << layer.N << " " << layer.K << " "
+                << t.DmaBytes() << " " << fltstr((double)t.DmaBytes() / t.macs, 4);
+            for (UINT32 operand = 0; operand < SCRATCHPAD::OPERAND_NUM; operand++)
+            {
+                out << " " << fltstr((double)t.usedBytes[operand] / t.loadBytes[operand], 2);
+            }
+            out << "\n";
+        }
+    }
 
-    dl2 = new DL2::CACHE("L2 Data Cache", 
-                        l2cacheSize,
-                        Knobl2LineSize.Value(),
-                        Knobl2Associativity.Value());
+    if (tlb)
+    {
+        out <<
+            "#\n"
+            "# TLB stats\n"
+            "#\n";
+        out << tlb->StatsLong("# ");
+
+        out << "#\n# layer   M   N   K   Translations   DTLB-Miss%   STLB-Miss%   Walks   Walk-Bytes\n";
+        for (UINT32 i = 0; i < layers.size(); i++)
+        {
+            DATA_TLB::COUNTERS c = (i + 1 < layers.size()) ? layers[i + 1].tlbStart : tlb->Counters();
+            c.Subtract(layers[i].tlbStart);
+
+            out << "# " << i << " " << layers[i].M << " " << layers[i].N << " " << layers[i].K << " "
+                << c.translations << " " << fltstr(100.0 * c.dtlbMisses / c.translations, 2) << " "
+                << fltstr(100.0 * c.stlbMisses / c.dtlbMisses, 2) << " "
+                << c.walks << " " << tlb->WalkTraffic(c) << "\n";
+        }
+    }
+
+    if (KnobTiming.Value())
+    {
+        for (UINT32 h = 0; h < hierarchies.size(); h++)
+        {
+            const TIMING * timing = hierarchies[h]->Timing();
+
+            out << "#\n# Configuration " << h << " timing per layer\n";
+            out << "# layer   M   N   K   Instructions   Cycles   IPC   Stall-Cycles   MLP\n";
+            for (UINT32 i = 0; i < layers.size(); i++)
+            {
+                TIMING::COUNTERS c = (i + 1 < layers.size()) ? layers[i + 1].timingStart[h] : timing->Counters();
+                c.Subtract(layers[i].timingStart[h]);
+
+                out << "# " << i << " " << layers[i].M << " " << layers[i].N << " " << layers[i].K << " "
+                    << c.instructions << " " << (UINT64)c.cycles << " " << fltstr(c.Ipc(), 3) << " "
+                    << (UINT64)c.stallCycles << " " << fltstr(c.Mlp(), 3) << "\n";
+            }
+        }
+    }
+
+    for (UINT32 h = 0; h < hierarchies.size(); h++)
+    {
+        const DRAM * dram = hierarchies[h]->Dram();
+        if (dram == NULL) continue;
+
+        out << "#\n# Configuration " << h << " DRAM per layer\n";
+        out << "# layer   M   N   K   Reads   Writes   Row-Hit%   Bus-Util%   GB/s   Energy-nJ\n";
+        for (UINT32 i = 0; i < layers.size(); i++)
+        {
+            DRAM::COUNTERS c = (i + 1 < layers.size()) ? layers[i + 1].dramStart[h] : dram->Counters();
+            c.Subtract(layers[i].dramStart[h]);
+
+            out << "# " << i << " " << layers[i].M << " " << layers[i].N << " " << layers[i].K << " "
+                << c.reads << " " << c.writes << " " << fltstr(dram->RowHitRate(c), 2) << " "
+                << fltstr(dram->Utilization(c), 2) << " " << fltstr(dram->Bandwidth(c), 3) << " "
+                << fltstr(dram->Energy(c), 1) << "\n";
+        }
+    }
+
+    out.close();
+
+    if (reuse)
+    {
+        std::ofstream profile(KnobReuseFile.Value().c_str());
+        const std::vector<REUSE_PROFILER::LAYER> & profiled = reuse->Layers();
+
+        profile << "# Reuse distances of " << reuse->LineSize() << " byte lines\n";
+        for (UINT32 i = 0; i < profiled.size(); i++)
+        {
+            if (profiled[i].accesses == 0) continue;
+            if (i == 0)
+            {
+                profile << "#\n# Before the first layer\n#\n";
+            }
+            else
+            {
+                const LAYER & layer = layers[i - 1];
+                profile << "#\n# Layer " << i - 1 << ": M " << layer.M << " N " << layer.N << " K " << layer.K << "\n#\n";
+            }
+            profile << reuse->StatsLong("# ", profiled[i]);
+        }
+        profile.close();
+    }
+
+    if (regionRoutines.size() < KnobRegionRoutine.NumberOfValues())
+    {
+        cerr << "Warning: only " << regionRoutines.size() << " of the " << KnobRegionRoutine.NumberOfValues()
+             << " -rtn routines were found, the others may have been inlined" << endl;
+    }
+
+    if (!KnobCheckpointSave.Value().empty() && !checkpointSaved)
+    {
+        if (KnobCheckpointRoi.Value() >= 0)
+        {
+            cerr << "Warning: region of interest " << KnobCheckpointRoi.Value() << " never started ("
+                 << roiSeen << " seen), " << KnobCheckpointSave.Value() << " holds the state at the end of the run" << endl;
+        }
+        SaveCheckpoint(KnobCheckpointSave.Value());
+    }
+
+    if (!KnobRecordFile.Value().empty())
+    {
+        WriteRecords(KnobRecordFile.Value(), KnobRecordFormat.Value());
+    }
+}
+
+/* ===================================================================== */
+
+int main(int argc, char *argv[])
+{
+    PIN_InitSymbols();
+
+    if( PIN_Init(argc,argv) )
+    {
+        return Usage();
+    }
     
+    DCACHE_CONFIG config;
+    config.l1CacheSize = Knobl1CacheSize.Value();
+    config.l1LineSize = Knobl1LineSize.Value();
+    config.l1Associativity = Knobl1Associativity.Value();
+#ifdef USE_L2_CACHE
+    config.l2CacheSize = Knobl2CacheSize.Value();
+    config.l2LineSize = Knobl2LineSize.Value();
+    config.l2Associativity = Knobl2Associativity.Value();
+#else
+    config.l2CacheSize = 0;
+    config.l2LineSize = 0;
+    config.l2Associativity = 0;
 #endif
 
+    std::vector<DCACHE_CONFIG> configs;
+    if (KnobSweepFile.Value().empty())
+    {
+        configs.push_back(config);
+    }
+    else if (!ReadSweepManifest(KnobSweepFile.Value(), config, configs) || configs.empty())
+    {
+        return Usage();
+    }
+
+    for (UINT32 i = 0; i < configs.size(); i++)
+    {
+        const DCACHE_CONFIG & c = configs[i];
+        if (!HasSets(c.l1CacheSize, c.l1LineSize, c.l1Associativity)
+#ifdef USE_L2_CACHE
+            || !HasSets(c.l2CacheSize, c.l2LineSize, c.l2Associativity)
+#endif
+            )
+        {
+            cerr << "Configuration " << i << ": each cache needs at least line size x associativity bytes" << endl;
+            return Usage();
+        }
+    }
+
+#if !defined(ECOLCACHE) && !defined(ESKEWCACHE)
+    if (Knobl1BufferKind.Value() != "victim" && Knobl1BufferKind.Value() != "miss")
+    {
+        cerr << "Unknown L1 buffer kind " << Knobl1BufferKind.Value() << endl;
+        return Usage();
+    }
+#endif
+#ifdef USE_L2_CACHE
+    if (Knobl2BufferKind.Value() != "victim" && Knobl2BufferKind.Value() != "miss")
+    {
+        cerr << "Unknown L2 buffer kind " << Knobl2BufferKind.Value() << endl;
+        return Usage();
+    }
+#endif
+
+    if (KnobRecordFormat.Value() != "json" && KnobRecordFormat.Value() != "csv")
+    {
+        cerr << "Unknown record format " << KnobRecordFormat.Value() << endl;
+        return Usage();
+    }
+
+    if (KnobCheckpointRoi.Value() >= 0 && !KnobRoi.Value())
+    {
+        cerr << "-ckptroi needs the region of interest markers of -roi 1" << endl;
+        return Usage();
+    }
+
+    // with -rtn the span grows from empty as the routines are found
+    regionLow = KnobRegionRoutine.NumberOfValues() == 0 ? KnobRegionLow.Value() : ~(ADDRINT)0;
+    regionHigh = KnobRegionRoutine.NumberOfValues() == 0 ? KnobRegionHigh.Value() : 0;
+
+    if (KnobTiming.Value() && (KnobTimingMshrs.Value() == 0 || KnobTimingWidth.Value() <= 0))
+    {
+        cerr << "The timing model needs at least one MSHR and a positive issue width" << endl;
+        return Usage();
+    }
+
+    if (KnobSectorSize.Value() > 0)
+    {
+        const UINT32 sector = KnobSectorSize.Value();
+        const UINT32 line = KnobSectorLineSize.Value();
+        if (!IsPower2(sector) || !IsPower2(line) || sector > line || line / sector > SECTORED_CACHE::MAX_SECTORS)
+        {
+            cerr << "Sector and sectored line sizes must be powers of two with at most "
+                 << SECTORED_CACHE::MAX_SECTORS << " sectors per line" << endl;
+            return Usage();
+        }
+        for (UINT32 i = 0; i < configs.size(); i++)
+        {
+            if (!HasSets(configs[i].l1CacheSize, line, configs[i].l1Associativity))
+            {
+                cerr << "Configuration " << i << ": a " << configs[i].l1CacheSize << " KB L1 has no set of "
+                     << configs[i].l1Associativity << " sectored " << line << " byte lines" << endl;
+                return Usage();
+            }
+        }
+    }
+
+    if (KnobInCache.Value() && (KnobInCacheGroup.Value() == 0 || KnobInCacheLanes.Value() == 0))
+    {
+        cerr << "In-cache computing needs at least one set per subarray and one lane" << endl;
+        return Usage();
+    }
+
+    std::vector<UINT32> partitionShares;
+    std::vector<PARTITIONED_CACHE::POLICY> partitionPolicies;
+    if (!KnobPartition.Value().empty())
+    {
+        if (KnobPartition.Value() != "ways" && KnobPartition.Value() != "sets")
+        {
+            cerr << "Unknown partitioning " << KnobPartition.Value() << endl;
+            return Usage();
+        }
+        if (!ReadPartition(partitionShares, partitionPolicies)) return Usage();
+
+        UINT32 total = 0;
+        for (UINT32 i = 0; i < ADDRESS_CLASSES::CLASS_NUM; i++)
+        {
+            total += partitionShares[i];
+            if (partitionShares[i] == 0 && partitionPolicies[i] == PARTITIONED_CACHE::POLICY_ALLOCATE)
+            {
+                cerr << "Class " << ADDRESS_CLASSES::Name(ADDRESS_CLASSES::CLASS(i))
+                     << " allocates but has no share of the cache" << endl;
+                return Usage();
+            }
+            if (partitionShares[i] == 0 && KnobPartition.Value() == "sets"
+                && partitionPolicies[i] != PARTITIONED_CACHE::POLICY_BYPASS)
+            {
+                cerr << "Class " << ADDRESS_CLASSES::Name(ADDRESS_CLASSES::CLASS(i))
+                     << " has no sets and must bypass" << endl;
+                return Usage();
+            }
+        }
+        for (UINT32 i = 0; i < configs.size(); i++)
+        {
+            if (KnobPartition.Value() == "ways" && total != configs[i].l1Associativity)
+            {
+                cerr << "Partition ways sum to " << total << " instead of the L1 associativity "
+                     << configs[i].l1Associativity << endl;
+                return Usage();
+            }
+        }
+        if (total == 0)
+        {
+            cerr << "Partition shares are all zero" << endl;
+            return Usage();
+        }
+    }
+
+#ifdef USE_DRAM_MODEL
+    if (KnobDram.Value())
+    {
+        if (KnobDramPolicy.Value() != "open" && KnobDramPolicy.Value() != "closed")
+        {
+            cerr << "Unknown DRAM page policy " << KnobDramPolicy.Value() << endl;
+            return Usage();
+        }
+        if (KnobDramChannels.Value() == 0 || KnobDramBanks.Value() == 0 || KnobDramBus.Value() == 0)
+        {
+            cerr << "DRAM needs at least one channel, one bank and a bus width" << endl;
+            return Usage();
+        }
+        for (UINT32 i = 0; i < configs.size(); i++)
+        {
+#ifdef USE_L2_CACHE
+            const UINT32 lineSize = configs[i].l2LineSize;
+#else
+            const UINT32 lineSize = configs[i].l1LineSize;
+#endif
+            if (KnobDramRowSize.Value() < lineSize)
+            {
+                cerr << "DRAM row smaller than a last level cache line" << endl;
+                return Usage();
+            }
+        }
+    }
+#endif
+
+    for (UINT32 i = 0; i < configs.size(); i++)
+    {
+        HIERARCHY * hierarchy = new HIERARCHY(configs[i]);
+        if (KnobTiming.Value())
+        {
+            hierarchy->AttachTiming(new TIMING(KnobTimingL1Latency.Value(),
+                                               KnobTimingL2Latency.Value(),
+                                               KnobTimingMemoryLatency.Value(),
+                                               KnobTimingMshrs.Value(),
+                                               KnobTimingWidth.Value(),
+                                               KnobTimingWindow.Value()));
+        }
+#ifdef USE_DRAM_MODEL
+        if (KnobDram.Value())
+        {
+            hierarchy->AttachDram(new DRAM(KnobDramChannels.Value(),
+                                           KnobDramBanks.Value(),
+                                           KnobDramRowSize.Value(),
+#ifdef USE_L2_CACHE
+                                           configs[i].l2LineSize,
+#else
+                                           configs[i].l1LineSize,
+#endif
+                                           KnobDramPolicy.Value() == "closed" ? DRAM::POLICY_CLOSED : DRAM::POLICY_OPEN,
+                                           KnobDramCas.Value(),
+                                           KnobDramRcd.Value(),
+                                           KnobDramRp.Value(),
+                                           KnobDramFaw.Value(),
+                                           KnobDramBus.Value(),
+                                           KnobDramClock.Value(),
+                                           KnobDramActivateEnergy.Value(),
+                                           KnobDramByteEnergy.Value()));
+        }
+#endif
+        if (KnobCompression.Value())
+        {
+            const UINT32 l1cacheSize = configs[i].l1CacheSize * KILO;
+            hierarchy->AttachCompression(new COMPRESSED_CACHE("L1 Compressed", l1cacheSize,
+                                                              configs[i].l1LineSize,
+                                                              configs[i].l1Associativity,
+                                                              true, PIN_SafeCopy),
+                                         new COMPRESSED_CACHE("L1 Uncompressed", l1cacheSize,
+                                                              configs[i].l1LineSize,
+                                                              configs[i].l1Associativity,
+                                                              false, PIN_SafeCopy));
+        }
+        if (KnobSectorSize.Value() > 0)
+        {
+            const UINT32 l1cacheSize = configs[i].l1CacheSize * KILO;
+            const UINT32 lineSize = KnobSectorLineSize.Value();
+            hierarchy->AttachSectored(new SECTORED_CACHE("L1 Sectored", l1cacheSize, lineSize,
+                                                         configs[i].l1Associativity, KnobSectorSize.Value()),
+                                      new SECTORED_CACHE("L1 Whole Line", l1cacheSize, lineSize,
+                                                         configs[i].l1Associativity, lineSize));
+        }
+        if (!KnobPartition.Value().empty())
+        {
+            const UINT32 l1cacheSize = configs[i].l1CacheSize * KILO;
+            hierarchy->AttachPartitioned(new PARTITIONED_CACHE("L1 Partitioned", l1cacheSize,
+                                                               configs[i].l1LineSize,
+                                                               configs[i].l1Associativity, addressClasses,
+                                                               KnobPartition.Value() == "sets" ? PARTITIONED_CACHE::MODE_SETS
+                                                                                               : PARTITIONED_CACHE::MODE_WAYS,
+                                                               partitionShares, partitionPolicies),
+                                         new PARTITIONED_CACHE("L1 Shared", l1cacheSize,
+                                                               configs[i].l1LineSize,
+                                                               configs[i].l1Associativity, addressClasses,
+                                                               PARTITIONED_CACHE::MODE_SHARED,
+                                                               partitionShares, partitionPolicies));
+        }
+        if (KnobInCache.Value())
+        {
+            const UINT32 l1cacheSize = configs[i].l1CacheSize * KILO;
+            hierarchy->AttachInCache(new IN_CACHE_COMPUTE(addressClasses, configs[i].l1LineSize,
+                                                          l1cacheSize / (configs[i].l1LineSize * configs[i].l1Associativity),
+                                                          KnobInCacheGroup.Value(),
+                                                          KnobInCacheLanes.Value(),
+                                                          KnobInCacheLatency.Value()));
+        }
+        hierarchies.push_back(hierarchy);
+    }
+
+    if (KnobSpmSize.Value() > 0)
+    {
+        spm = new SCRATCHPAD("Scratchpad",
+                             KnobSpmSize.Value() * KILO,
+                             KnobSpmTileM.Value(),
+                             KnobSpmTileN.Value(),
+                             KnobSpmTileK.Value(),
+                             KnobSpmDoubleBuffer.Value());
+
+        if (spm->Slots(SCRATCHPAD::OPERAND_A) == 0 || spm->Slots(SCRATCHPAD::OPERAND_B) == 0
+            || spm->Slots(SCRATCHPAD::OPERAND_C) == 0)
+        {
+            cerr << "Scratchpad too small for the requested tiles" << endl;
+            return Usage();
+        }
+    }
+
+    if (KnobDtlbEntries.Value() > 0)
+    {
+        const UINT32 pageSize = KnobTlbPage.Value() * KILO;
+        const UINT64 maxEntries = 0xffffffffULL / pageSize;
+
+        if (pageSize != 4 * KILO && pageSize != 2 * MEGA)
+        {
+            cerr << "TLB page size must be 4 or 2048 KB" << endl;
+            return Usage();
+        }
+        if (KnobDtlbEntries.Value() > maxEntries || KnobStlbEntries.Value() > maxEntries)
+        {
+            cerr << "Too many TLB entries for " << KnobTlbPage.Value() << " KB pages" << endl;
+            return Usage();
+        }
+        tlb = new DATA_TLB(pageSize,
+                           KnobDtlbEntries.Value(),
+                           KnobDtlbAssociativity.Value(),
+                           KnobStlbEntries.Value(),
+                           KnobStlbAssociativity.Value(),
+                           KnobWalkBytes.Value());
+    }
+
+    if (!KnobReuseFile.Value().empty())
+    {
+        if (!IsPower2(KnobReuseLineSize.Value()) || KnobReuseStep.Value() == 0)
+        {
+            cerr << "Reuse profile line size must be a power of two and its step positive" << endl;
+            return Usage();
+        }
+        reuse = new REUSE_PROFILER(addressClasses, KnobReuseLineSize.Value(), KnobReuseStep.Value());
+    }
+
+    layerCalls = spm || tlb || reuse || KnobTiming.Value() || KnobInCache.Value()
+                 || !KnobPartition.Value().empty();
+#ifdef USE_DRAM_MODEL
+    layerCalls = layerCalls || KnobDram.Value();
+#endif
+
+    if (!KnobCheckpointLoad.Value().empty() && !RestoreCheckpoint(KnobCheckpointLoad.Value()))
+    {
+        cerr << "Checkpoint " << KnobCheckpointLoad.Value() << " does not match the simulated configurations" << endl;
+        return Usage();
+    }
+
+    if (KnobRoi.Value())
+    {
+        simMode = SIM_FAST_FORWARD;
+        detailedStarted = false;
+    }
+
+    IMG_AddInstrumentFunction(Image, 0);
     INS_AddInstrumentFunction(Instruction, 0);
     PIN_AddFiniFunction(Fini, 0);
 